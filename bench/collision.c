@@ -0,0 +1,381 @@
+/*
+ * Times the distance tests of every collision call site, the sqrt based
+ * form the game used to have against the collision.h primitive, on data
+ * shaped like the arena. Both forms must give the same answers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include "game.h"
+#include "collision.h"
+
+#define RUNS				(15)
+#define QUERIES				(1024)
+#define ARENA_SIZE			(1200.0)
+#define SNAKE_LEN			(1260)
+#define OTHER_SNAKES		(128)
+#define OTHER_LEN			(120)
+#define WALLS_NUM			(4)
+#define OBSTACLES_NUM		(16)
+#define CONSUMABLES_NUM		(20)
+#define SAFE_DISTANCE		(48.0)
+
+static struct Vec2D snake[SNAKE_LEN];
+static struct Vec2D others[OTHER_SNAKES][OTHER_LEN];
+static struct Vec2D heads[OTHER_SNAKES];
+static struct Vec2D wall_dists[QUERIES][WALLS_NUM];
+static double wall_r[WALLS_NUM];
+static struct Obstacle obstacles[OBSTACLES_NUM];
+static struct Consumable consumables[CONSUMABLES_NUM];
+static struct Vec2D queries[QUERIES];
+static struct Vec2D eyes[QUERIES][AI_DUMB_EYES_NUM];
+static unsigned int seed = 12345;
+static volatile long sink;
+
+static double uniform(double lo, double hi);
+static double now_ns(void);
+static int compare_doubles(const void *a, const void *b);
+static double vlength(double x, double y);
+static int circle_count_points(const struct Vec2D *center, double dist,
+	const struct Vec2D points[], int num);
+static int segments_first_hit(const struct Vec2D *pos, double margin,
+	const void *base, size_t stride, int from, int num);
+static void prepare(void);
+static long self_before(int q);
+static long self_after(int q);
+static long wall_before(int q);
+static long wall_after(int q);
+static long obstacle_before(int q);
+static long obstacle_after(int q);
+static long eat_before(int q);
+static long eat_after(int q);
+static long eyes_before(int q);
+static long eyes_after(int q);
+static long safe_before(int q);
+static long safe_after(int q);
+static double measure(long (*site)(int q), long *result);
+
+static double uniform(double lo, double hi)
+{
+	seed = seed * 1103515245u + 12345u;
+	return lo + (hi - lo) * ((seed >> 8) & 0xffffff) / (double)0x1000000;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double vlength(double x, double y)
+{
+	return sqrt(x * x + y * y);
+}
+
+// number of the points closer than dist to center
+static int circle_count_points(const struct Vec2D *center, double dist,
+	const struct Vec2D points[], int num)
+{
+	int count = 0;
+	for (int i = 0; i < num; ++i)
+	{
+		count += circle_hit(&points[i], center, dist);
+	}
+	return count;
+}
+
+// scans the segments placed every stride bytes from base (so any array of
+// structures starting with struct Segment will do), returns the index of
+// the first one in [from, num) hit by pos with margin added to its radius
+// or -1 if there is none
+static int segments_first_hit(const struct Vec2D *pos, double margin,
+	const void *base, size_t stride, int from, int num)
+{
+	for (int i = from; i < num; ++i)
+	{
+		const struct Segment *seg = (const struct Segment *)((const char *)base + i * stride);
+		if (circle_hit(pos, &seg->pos, seg->r + margin))
+			return i;
+	}
+	return -1;
+}
+
+static void prepare(void)
+{
+	// a coiled snake, so the head passes close to its own body
+	for (int i = 0; i < SNAKE_LEN; ++i)
+	{
+		const double fi = i * PIECE_DISTANCE / 40.0;
+		snake[i] = (struct Vec2D) { .x = 600 + (40 + 3 * fi) * cos(fi), .y = 600 + (40 + 3 * fi) * sin(fi) };
+	}
+	for (int k = 0; k < OTHER_SNAKES; ++k)
+	{
+		struct Vec2D pos = { .x = uniform(0, ARENA_SIZE), .y = uniform(0, ARENA_SIZE) };
+		const double angle = uniform(0, 2 * M_PI);
+		heads[k] = pos;
+		for (int i = 0; i < OTHER_LEN; ++i)
+		{
+			others[k][i] = (struct Vec2D) { .x = pos.x - i * PIECE_DISTANCE * cos(angle),
+				.y = pos.y - i * PIECE_DISTANCE * sin(angle) };
+		}
+	}
+	for (int i = 0; i < WALLS_NUM; ++i)
+	{
+		wall_r[i] = 10;
+	}
+	for (int i = 0; i < OBSTACLES_NUM; ++i)
+	{
+		obstacles[i].segment = (struct Segment) { .pos = { .x = uniform(0, ARENA_SIZE), .y = uniform(0, ARENA_SIZE) },
+			.r = uniform(12, 24) };
+		obstacles[i].valid = true;
+	}
+	for (int i = 0; i < CONSUMABLES_NUM; ++i)
+	{
+		consumables[i].segment = (struct Segment) { .pos = { .x = uniform(0, ARENA_SIZE), .y = uniform(0, ARENA_SIZE) },
+			.r = CONSUMABLE_RADIUS };
+	}
+	for (int q = 0; q < QUERIES; ++q)
+	{
+		// some of the queries land on the coil, the rest anywhere
+		queries[q] = q % 4 ? (struct Vec2D) { .x = uniform(0, ARENA_SIZE), .y = uniform(0, ARENA_SIZE) }
+			: snake[(int)uniform(START_LEN + 2, SNAKE_LEN)];
+		for (int i = 0; i < WALLS_NUM; ++i)
+		{
+			wall_dists[q][i] = (struct Vec2D) { .x = uniform(-ARENA_SIZE, ARENA_SIZE) / 8,
+				.y = uniform(-ARENA_SIZE, ARENA_SIZE) / 8 };
+		}
+		for (int j = 0; j < AI_DUMB_EYES_NUM; ++j)
+		{
+			eyes[q][j] = (struct Vec2D) { .x = queries[q].x + uniform(-40, 40), .y = queries[q].y + uniform(-40, 40) };
+		}
+	}
+}
+
+// snake_check_selfcollision
+static long self_before(int q)
+{
+	const struct Vec2D *head = &queries[q];
+	for (int i = SNAKE_LEN - 1; i > START_LEN + 1; i -= PIECE_DRAW_INCREMENT)
+	{
+		if (vlength(head->x - snake[i].x, head->y - snake[i].y) < HEAD_RADIUS + BODY_RADIUS)
+			return i;
+	}
+	return -1;
+}
+
+static long self_after(int q)
+{
+	return points_first_hit(&queries[q], HEAD_RADIUS + BODY_RADIUS,
+		snake, SNAKE_LEN - 1, START_LEN + 1, PIECE_DRAW_INCREMENT);
+}
+
+// snake_check_wallcollision, on the vectors wall_dist would give
+static long wall_before(int q)
+{
+	for (int i = 0; i < WALLS_NUM; ++i)
+	{
+		if (vlength(wall_dists[q][i].x, wall_dists[q][i].y) < HEAD_RADIUS + wall_r[i])
+			return i;
+	}
+	return -1;
+}
+
+static long wall_after(int q)
+{
+	for (int i = 0; i < WALLS_NUM; ++i)
+	{
+		if (vec_within(&wall_dists[q][i], HEAD_RADIUS + wall_r[i]))
+			return i;
+	}
+	return -1;
+}
+
+// snake_check_obstaclecollision
+static long obstacle_before(int q)
+{
+	for (int i = 0; i < OBSTACLES_NUM; ++i)
+	{
+		if (!obstacles[i].valid)
+			continue;
+		const struct Segment *seg = &obstacles[i].segment;
+		if (vlength(queries[q].x - seg->pos.x, queries[q].y - seg->pos.y) < HEAD_RADIUS + seg->r)
+			return i;
+	}
+	return -1;
+}
+
+static long obstacle_after(int q)
+{
+	const size_t stride = sizeof(struct Obstacle);
+	for (int i = segments_first_hit(&queries[q], HEAD_RADIUS, obstacles, stride, 0, OBSTACLES_NUM);
+		i >= 0;
+		i = segments_first_hit(&queries[q], HEAD_RADIUS, obstacles, stride, i + 1, OBSTACLES_NUM))
+	{
+		if (obstacles[i].valid)
+			return i;
+	}
+	return -1;
+}
+
+// snake_eat_consumables, the number eaten
+static long eat_before(int q)
+{
+	long eaten = 0;
+	for (int i = 0; i < CONSUMABLES_NUM; ++i)
+	{
+		const struct Segment *seg = &consumables[i].segment;
+		if (vlength(queries[q].x - seg->pos.x, queries[q].y - seg->pos.y) < HEAD_RADIUS + seg->r - EAT_DEPTH)
+			eaten = eaten * CONSUMABLES_NUM + i + 1;
+	}
+	return eaten;
+}
+
+static long eat_after(int q)
+{
+	long eaten = 0;
+	const size_t stride = sizeof(struct Consumable);
+	for (int i = segments_first_hit(&queries[q], HEAD_RADIUS - EAT_DEPTH, consumables, stride, 0, CONSUMABLES_NUM);
+		i >= 0;
+		i = segments_first_hit(&queries[q], HEAD_RADIUS - EAT_DEPTH, consumables, stride, i + 1, CONSUMABLES_NUM))
+	{
+		eaten = eaten * CONSUMABLES_NUM + i + 1;
+	}
+	return eaten;
+}
+
+// snake_ai_dumb_control, the eyes against the bodies of the others
+static long eyes_before(int q)
+{
+	int leftd = 0;
+	int rightd = 0;
+	const double dist = BODY_RADIUS + AI_DUMB_DETECTION_MARGIN;
+	for (int k = 0; k < OTHER_SNAKES; ++k)
+	{
+		for (int i = OTHER_LEN - 1; i >= 0; i -= PIECE_DRAW_INCREMENT)
+		{
+			for (int j = 0; j < AI_DUMB_EYES_NUM / 2; ++j)
+			{
+				if (vlength(others[k][i].x - eyes[q][j].x, others[k][i].y - eyes[q][j].y) < dist)
+					++leftd;
+			}
+			for (int j = AI_DUMB_EYES_NUM / 2; j < AI_DUMB_EYES_NUM; ++j)
+			{
+				if (vlength(others[k][i].x - eyes[q][j].x, others[k][i].y - eyes[q][j].y) < dist)
+					++rightd;
+			}
+		}
+	}
+	return leftd * 1000 + rightd;
+}
+
+static long eyes_after(int q)
+{
+	int leftd = 0;
+	int rightd = 0;
+	const double dist = BODY_RADIUS + AI_DUMB_DETECTION_MARGIN;
+	for (int k = 0; k < OTHER_SNAKES; ++k)
+	{
+		for (int i = OTHER_LEN - 1; i >= 0; i -= PIECE_DRAW_INCREMENT)
+		{
+			leftd += circle_count_points(&others[k][i], dist, eyes[q], AI_DUMB_EYES_NUM / 2);
+			rightd += circle_count_points(&others[k][i], dist, eyes[q] + AI_DUMB_EYES_NUM / 2, AI_DUMB_EYES_NUM / 2);
+		}
+	}
+	return leftd * 1000 + rightd;
+}
+
+// generate_safe_position, the heads and the obstacles
+static long safe_before(int q)
+{
+	const struct Vec2D *pos = &queries[q];
+	for (int i = 0; i < OTHER_SNAKES; ++i)
+	{
+		if (vlength(pos->x - heads[i].x, pos->y - heads[i].y) < SAFE_DISTANCE)
+			return 0;
+	}
+	for (int i = 0; i < OBSTACLES_NUM; ++i)
+	{
+		const struct Segment *seg = &obstacles[i].segment;
+		if (vlength(pos->x - seg->pos.x, pos->y - seg->pos.y) - seg->r < SAFE_DISTANCE)
+			return 0;
+	}
+	return 1;
+}
+
+static long safe_after(int q)
+{
+	const struct Vec2D *pos = &queries[q];
+	for (int i = 0; i < OTHER_SNAKES; ++i)
+	{
+		if (circle_hit(pos, &heads[i], SAFE_DISTANCE))
+			return 0;
+	}
+	for (int i = 0; i < OBSTACLES_NUM; ++i)
+	{
+		if (circle_hit(pos, &obstacles[i].segment.pos, SAFE_DISTANCE + obstacles[i].segment.r))
+			return 0;
+	}
+	return 1;
+}
+
+// median time of a call in ns, result gets the answers summed up
+static double measure(long (*site)(int q), long *result)
+{
+	double runs[RUNS];
+	*result = 0;
+	for (int r = 0; r < RUNS; ++r)
+	{
+		long sum = 0;
+		const double start = now_ns();
+		for (int q = 0; q < QUERIES; ++q)
+		{
+			sum += site(q) * (q + 1);
+		}
+		runs[r] = (now_ns() - start) / QUERIES;
+		sink = sum;
+		*result = sum;
+	}
+	qsort(runs, RUNS, sizeof(double), compare_doubles);
+	return runs[RUNS / 2];
+}
+
+int main(void)
+{
+	const struct
+	{
+		const char *name;
+		long (*before)(int q);
+		long (*after)(int q);
+	} sites[] = {
+		{ "snake_check_selfcollision", self_before, self_after },
+		{ "snake_check_wallcollision", wall_before, wall_after },
+		{ "snake_check_obstaclecollision", obstacle_before, obstacle_after },
+		{ "snake_eat_consumables", eat_before, eat_after },
+		{ "snake_ai_dumb_control", eyes_before, eyes_after },
+		{ "generate_safe_position", safe_before, safe_after },
+	};
+	int failed = 0;
+
+	prepare();
+	printf("%-32s %12s %12s\n", "median ns per call", "sqrt", "squared");
+	for (size_t i = 0; i < sizeof(sites) / sizeof(sites[0]); ++i)
+	{
+		long before_result = 0;
+		long after_result = 0;
+		const double before = measure(sites[i].before, &before_result);
+		const double after = measure(sites[i].after, &after_result);
+		printf("%-32s %12.1f %12.1f%s\n", sites[i].name, before, after,
+			before_result == after_result ? "" : "  MISMATCH");
+		failed |= before_result != after_result;
+	}
+	return failed;
+}
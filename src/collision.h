@@ -0,0 +1,87 @@
+#ifndef _H_COLLISION
+#define _H_COLLISION
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+#include "game.h"
+
+/*
+ * Collision primitives working on squared distances, so no sqrt is
+ * needed. Every axis is checked on its own first - most of the tested
+ * pairs are far apart and get rejected before any multiplication.
+ * A non-positive distance never hits.
+ */
+
+// |vec| < dist
+static inline bool vec_within(const struct Vec2D *vec, double dist)
+{
+	if (vec->x >= dist || vec->x <= -dist)
+		return false;
+	if (vec->y >= dist || vec->y <= -dist)
+		return false;
+	return vec->x * vec->x + vec->y * vec->y < dist * dist;
+}
+
+// |pos - center| < dist
+static inline bool circle_hit(const struct Vec2D *pos, const struct Vec2D *center, double dist)
+{
+	struct Vec2D diff = { .x = pos->x - center->x, .y = pos->y - center->y };
+	return vec_within(&diff, dist);
+}
+
+// adds one to hits[i] for every point closer than dist to center, the
+// same test as circle_hit without the early outs, so the points can go
+// through the vector lanes side by side
+static inline void circle_mark_points(const struct Vec2D *center, double dist,
+	const struct Vec2D points[], int hits[], int num)
+{
+	if (dist <= 0)
+		return;
+	const double cx = center->x;
+	const double cy = center->y;
+	const double dist2 = dist * dist;
+	for (int i = 0; i < num; ++i)
+	{
+		const double dx = points[i].x - cx;
+		const double dy = points[i].y - cy;
+		hits[i] += dx * dx + dy * dy < dist2;
+	}
+}
+
+// scans points[from], points[from - step]... while the index is greater
+// than until, returns the index of the first one closer than dist to pos
+// or -1 if there is none
+static inline int points_first_hit(const struct Vec2D *pos, double dist,
+	const struct Vec2D points[], int from, int until, int step)
+{
+	for (int i = from; i > until; i -= step)
+	{
+		if (circle_hit(pos, &points[i], dist))
+			return i;
+	}
+	return -1;
+}
+
+// first t in [0, 1] at which from + t * (to - from) gets closer than
+// dist to center, 0 if it starts there, -1 if it never does
+static inline double sweep_circle(const struct Vec2D *from, const struct Vec2D *to,
+	const struct Vec2D *center, double dist)
+{
+	const struct Vec2D f = { .x = from->x - center->x, .y = from->y - center->y };
+	const struct Vec2D d = { .x = to->x - from->x, .y = to->y - from->y };
+	const double c = f.x * f.x + f.y * f.y - dist * dist;
+	if (c < 0)
+		return 0;
+	const double b = f.x * d.x + f.y * d.y;
+	if (b >= 0)
+		return -1;	// not approaching
+	const double a = d.x * d.x + d.y * d.y;
+	const double disc = b * b - a * c;
+	if (disc <= 0)
+		return -1;
+	const double t = (-b - sqrt(disc)) / a;
+	return t <= 1 ? t : -1;
+}
+
+#endif
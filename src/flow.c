@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "flow.h"
+#include "sdf.h"
+#include "game.h"
+
+// a head placed in the middle of a walkable cell does not touch anything
+#define FLOW_CLEARANCE					(HEAD_RADIUS)
+
+static const int flow_dx[8] = { 1, -1, 0, 0, 1, 1, -1, -1 };
+static const int flow_dy[8] = { 0, 0, 1, -1, 1, -1, 1, -1 };
+static const int flow_cost[8] = {
+	FLOW_STEP_COST, FLOW_STEP_COST, FLOW_STEP_COST, FLOW_STEP_COST,
+	FLOW_DIAGONAL_COST, FLOW_DIAGONAL_COST, FLOW_DIAGONAL_COST, FLOW_DIAGONAL_COST
+};
+
+static int flow_cell(const struct FlowField *field, const struct Vec2D *pos);
+static bool flow_can_step(const struct FlowField *field, int x, int y, int k);
+static bool flow_source_kept(const struct FlowField *field, int cell);
+static void flow_push(struct FlowField *field, int dist, int cell);
+static void flow_pop(struct FlowField *field, struct FlowNode *node);
+static void flow_push_neighbours(struct FlowField *field, int cell);
+static void flow_relax(struct FlowField *field);
+
+void flow_init(struct FlowField *field, const struct Vec2D *bb_min, const struct Vec2D *bb_max,
+	int targets_num)
+{
+	field->origin_x = bb_min->x;
+	field->origin_y = bb_min->y;
+	field->inv_cell_size = 1.0 / FLOW_CELL_SIZE;
+	field->cols = (int)ceil((bb_max->x - bb_min->x) * field->inv_cell_size);
+	field->rows = (int)ceil((bb_max->y - bb_min->y) * field->inv_cell_size);
+	if (field->cols < 1)
+		field->cols = 1;
+	if (field->rows < 1)
+		field->rows = 1;
+	const int num = field->cols * field->rows;
+	field->dist = (int *)malloc(num * sizeof(int));
+	field->source = (int *)malloc(num * sizeof(int));
+	field->walkable = (bool *)calloc(num, sizeof(bool));
+	field->targets_num = targets_num;
+	field->target_cell = (int *)malloc(targets_num * sizeof(int));
+	field->target_next = (int *)malloc(targets_num * sizeof(int));
+	for (int i = 0; i < targets_num; ++i)
+	{
+		field->target_cell[i] = field->target_next[i] = -1;
+	}
+	field->rebuild = true;
+	field->changes = 0;
+	field->heap = NULL;
+	field->heap_num = 0;
+	field->heap_capacity = 0;
+}
+
+void flow_dispose(struct FlowField *field)
+{
+	free(field->dist);
+	free(field->source);
+	free(field->walkable);
+	free(field->target_cell);
+	free(field->target_next);
+	free(field->heap);
+	field->dist = NULL;
+	field->source = NULL;
+	field->walkable = NULL;
+	field->target_cell = NULL;
+	field->target_next = NULL;
+	field->heap = NULL;
+	field->cols = field->rows = 0;
+	field->targets_num = 0;
+	field->heap_num = 0;
+	field->heap_capacity = 0;
+}
+
+void flow_copy(struct FlowField *dst, const struct FlowField *src)
+{
+	if (dst->dist && dst->changes == src->changes)
+		return;
+	const int num = src->cols * src->rows;
+	if (!dst->dist)
+	{
+		dst->dist = (int *)malloc(num * sizeof(int));
+		dst->source = NULL;
+		dst->walkable = (bool *)malloc(num * sizeof(bool));
+		dst->target_cell = dst->target_next = NULL;
+		dst->targets_num = 0;
+		dst->heap = NULL;
+		dst->heap_num = dst->heap_capacity = 0;
+	}
+	dst->origin_x = src->origin_x;
+	dst->origin_y = src->origin_y;
+	dst->inv_cell_size = src->inv_cell_size;
+	dst->cols = src->cols;
+	dst->rows = src->rows;
+	dst->rebuild = false;
+	dst->changes = src->changes;
+	memcpy(dst->dist, src->dist, num * sizeof(int));
+	memcpy(dst->walkable, src->walkable, num * sizeof(bool));
+}
+
+// -1 outside of the field
+static int flow_cell(const struct FlowField *field, const struct Vec2D *pos)
+{
+	const double fx = (pos->x - field->origin_x) * field->inv_cell_size;
+	const double fy = (pos->y - field->origin_y) * field->inv_cell_size;
+	if (!(fx >= 0 && fy >= 0 && fx < field->cols && fy < field->rows))
+		return -1;
+	return (int)fy * field->cols + (int)fx;
+}
+
+// moving from the cell at (x, y) in the k-th direction, corners of the
+// geometry are not cut
+static bool flow_can_step(const struct FlowField *field, int x, int y, int k)
+{
+	const int nx = x + flow_dx[k];
+	const int ny = y + flow_dy[k];
+	if (nx < 0 || ny < 0 || nx >= field->cols || ny >= field->rows)
+		return false;
+	if (!field->walkable[ny * field->cols + nx])
+		return false;
+	return (0 == flow_dx[k] || 0 == flow_dy[k]) ||
+		(field->walkable[y * field->cols + nx] && field->walkable[ny * field->cols + x]);
+}
+
+// whether the way from the cell still leads to a target that stays put
+static bool flow_source_kept(const struct FlowField *field, int cell)
+{
+	const int source = field->source[cell];
+	return source >= 0 && field->target_cell[source] == field->target_next[source];
+}
+
+static void flow_push(struct FlowField *field, int dist, int cell)
+{
+	if (field->heap_num == field->heap_capacity)
+	{
+		field->heap_capacity = field->heap_capacity ? field->heap_capacity * 2 : 256;
+		field->heap = (struct FlowNode *)realloc(field->heap,
+			field->heap_capacity * sizeof(struct FlowNode));
+	}
+	int i = field->heap_num++;
+	while (i > 0)
+	{
+		const int parent = (i - 1) / 2;
+		if (field->heap[parent].dist <= dist)
+			break;
+		field->heap[i] = field->heap[parent];
+		i = parent;
+	}
+	field->heap[i] = (struct FlowNode) { .dist = dist, .cell = cell };
+}
+
+static void flow_pop(struct FlowField *field, struct FlowNode *node)
+{
+	*node = field->heap[0];
+	const struct FlowNode last = field->heap[--field->heap_num];
+	int i = 0;
+	while (true)
+	{
+		int child = 2 * i + 1;
+		if (child >= field->heap_num)
+			break;
+		if (child + 1 < field->heap_num && field->heap[child + 1].dist < field->heap[child].dist)
+			++child;
+		if (last.dist <= field->heap[child].dist)
+			break;
+		field->heap[i] = field->heap[child];
+		i = child;
+	}
+	if (field->heap_num > 0)
+		field->heap[i] = last;
+}
+
+// the ways known around the cell are followed again from there
+static void flow_push_neighbours(struct FlowField *field, int cell)
+{
+	const int x = cell % field->cols;
+	const int y = cell / field->cols;
+	for (int k = 0; k < 8; ++k)
+	{
+		const int nx = x + flow_dx[k];
+		const int ny = y + flow_dy[k];
+		if (nx < 0 || ny < 0 || nx >= field->cols || ny >= field->rows)
+			continue;
+		const int n = ny * field->cols + nx;
+		if (field->dist[n] != FLOW_UNREACHED)
+			flow_push(field, field->dist[n], n);
+	}
+}
+
+// Dijkstra from everything queued, the distances only go down
+static void flow_relax(struct FlowField *field)
+{
+	while (field->heap_num > 0)
+	{
+		struct FlowNode node;
+		flow_pop(field, &node);
+		// superseded, or forgotten since it was queued
+		if (node.dist != field->dist[node.cell])
+			continue;
+		const int x = node.cell % field->cols;
+		const int y = node.cell / field->cols;
+		for (int k = 0; k < 8; ++k)
+		{
+			if (!flow_can_step(field, x, y, k))
+				continue;
+			const int n = (y + flow_dy[k]) * field->cols + x + flow_dx[k];
+			const int dist = node.dist + flow_cost[k];
+			if (dist < field->dist[n])
+			{
+				field->dist[n] = dist;
+				field->source[n] = field->source[node.cell];
+				flow_push(field, dist, n);
+			}
+		}
+	}
+}
+
+void flow_block(struct FlowField *field, const struct DistanceField *sdf,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max)
+{
+	if (!field->walkable)
+		return;
+	int x1 = 0;
+	int y1 = 0;
+	int x2 = field->cols - 1;
+	int y2 = field->rows - 1;
+	if (clip_min)
+	{
+		x1 = (int)fmax(floor((clip_min->x - field->origin_x) * field->inv_cell_size), x1);
+		y1 = (int)fmax(floor((clip_min->y - field->origin_y) * field->inv_cell_size), y1);
+	}
+	if (clip_max)
+	{
+		x2 = (int)fmin(floor((clip_max->x - field->origin_x) * field->inv_cell_size), x2);
+		y2 = (int)fmin(floor((clip_max->y - field->origin_y) * field->inv_cell_size), y2);
+	}
+	for (int y = y1; y <= y2; ++y)
+		for (int x = x1; x <= x2; ++x)
+		{
+			const struct Vec2D center = {
+				.x = field->origin_x + (x + 0.5) * FLOW_CELL_SIZE,
+				.y = field->origin_y + (y + 0.5) * FLOW_CELL_SIZE
+			};
+			const int cell = y * field->cols + x;
+			const bool walkable = sdf_lower_bound(sdf, &center) >= FLOW_CLEARANCE;
+			if (walkable == field->walkable[cell])
+				continue;
+			field->walkable[cell] = walkable;
+			// a new cell only shortens the ways, a lost one may break them
+			if (!walkable)
+				field->rebuild = true;
+			else if (!field->rebuild)
+				flow_push_neighbours(field, cell);
+		}
+}
+
+void flow_set_target(struct FlowField *field, int target, const struct Vec2D *pos)
+{
+	field->target_next[target] = pos ? flow_cell(field, pos) : -1;
+}
+
+void flow_update(struct FlowField *field)
+{
+	const int num = field->cols * field->rows;
+	bool moved = false;
+	for (int i = 0; i < field->targets_num; ++i)
+	{
+		if (field->target_cell[i] != field->target_next[i])
+		{
+			moved = true;
+			break;
+		}
+	}
+	if (!moved && !field->rebuild && 0 == field->heap_num)
+		return;
+	++field->changes;
+
+	if (field->rebuild)
+	{
+		field->heap_num = 0;
+		for (int i = 0; i < num; ++i)
+		{
+			field->dist[i] = FLOW_UNREACHED;
+			field->source[i] = -1;
+		}
+		field->rebuild = false;
+	}
+	else if (moved)
+	{
+		// the ways to the targets that moved are forgotten, the ones
+		// around them are followed again into the cells left
+		for (int i = 0; i < num; ++i)
+		{
+			if (field->source[i] < 0 || flow_source_kept(field, i))
+				continue;
+			field->dist[i] = FLOW_UNREACHED;
+			field->source[i] = -1;
+			const int x = i % field->cols;
+			const int y = i / field->cols;
+			for (int k = 0; k < 8; ++k)
+			{
+				const int nx = x + flow_dx[k];
+				const int ny = y + flow_dy[k];
+				if (nx < 0 || ny < 0 || nx >= field->cols || ny >= field->rows)
+					continue;
+				const int n = ny * field->cols + nx;
+				if (flow_source_kept(field, n))
+					flow_push(field, field->dist[n], n);
+			}
+		}
+	}
+
+	// every target is a source, also the ones sharing a cell that was forgotten
+	for (int i = 0; i < field->targets_num; ++i)
+	{
+		const int cell = field->target_cell[i] = field->target_next[i];
+		if (cell < 0 || 0 == field->dist[cell])
+			continue;
+		field->dist[cell] = 0;
+		field->source[cell] = i;
+		flow_push(field, 0, cell);
+	}
+	flow_relax(field);
+}
+
+bool flow_distance(const struct FlowField *field, const struct Vec2D *pos, double *dist)
+{
+	const int cell = flow_cell(field, pos);
+	if (cell < 0 || FLOW_UNREACHED == field->dist[cell])
+		return false;
+	*dist = field->dist[cell] * (FLOW_CELL_SIZE / FLOW_STEP_COST);
+	return true;
+}
+
+bool flow_direction(const struct FlowField *field, const struct Vec2D *pos, struct Vec2D *dir)
+{
+	const int cell = flow_cell(field, pos);
+	if (cell < 0)
+		return false;
+	int x = cell % field->cols;
+	int y = cell / field->cols;
+	int best = field->dist[cell];
+	int steps = 0;
+	// the way is followed a few cells ahead, so it is not steered
+	// around every corner of the cells
+	while (steps < FLOW_LOOKAHEAD && best > 0)
+	{
+		int next = -1;
+		for (int k = 0; k < 8; ++k)
+		{
+			if (!flow_can_step(field, x, y, k))
+				continue;
+			const int n = (y + flow_dy[k]) * field->cols + x + flow_dx[k];
+			if (field->dist[n] < best)
+			{
+				best = field->dist[n];
+				next = k;
+			}
+		}
+		if (next < 0)
+			break;
+		x += flow_dx[next];
+		y += flow_dy[next];
+		++steps;
+	}
+	if (0 == steps)
+		return false;
+	dir->x = field->origin_x + (x + 0.5) * FLOW_CELL_SIZE - pos->x;
+	dir->y = field->origin_y + (y + 0.5) * FLOW_CELL_SIZE - pos->y;
+	return true;
+}
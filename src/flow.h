@@ -0,0 +1,75 @@
+#ifndef _H_FLOW
+#define _H_FLOW
+
+#include <stdbool.h>
+
+// spacing of the cells
+#if defined(MIYOO)
+#define FLOW_CELL_SIZE					(16.0)
+#define FLOW_LOOKAHEAD					(2)
+#else
+#define FLOW_CELL_SIZE					(8.0)
+#define FLOW_LOOKAHEAD					(4)
+#endif
+// cost of a step to a side and to a corner, close to 1 : sqrt(2)
+#define FLOW_STEP_COST					(5)
+#define FLOW_DIAGONAL_COST				(7)
+#define FLOW_UNREACHED					(0x7fffffff)
+
+struct Vec2D;
+struct DistanceField;
+
+struct FlowNode
+{
+	int dist;
+	int cell;
+};
+
+// cost of the shortest way around the static geometry from every cell
+// to the nearest of a set of targets, kept up to date incrementally
+struct FlowField
+{
+	double origin_x;
+	double origin_y;
+	double inv_cell_size;
+	int cols;
+	int rows;
+	int *dist;		// FLOW_UNREACHED if there is no way
+	int *source;	// the target the way leads to, -1 if none
+	bool *walkable;
+	// cells of the targets as of the last flow_update and as set since then,
+	// -1 for no target
+	int *target_cell;
+	int *target_next;
+	int targets_num;
+	bool rebuild;	// the field has to be computed from scratch
+	unsigned int changes;	// updates made, a copy is current if it has as many
+	// priority queue of the cells to relax
+	struct FlowNode *heap;
+	int heap_num;
+	int heap_capacity;
+};
+
+void flow_init(struct FlowField *field, const struct Vec2D *bb_min, const struct Vec2D *bb_max,
+	int targets_num);
+void flow_dispose(struct FlowField *field);
+// the ways only, for flow_distance and flow_direction, dst is zeroed
+// or a copy of the same field, it is left as it is when current
+void flow_copy(struct FlowField *dst, const struct FlowField *src);
+
+// cells too close to the geometry are not walkable, the clipping box
+// limits the cells touched, NULL for all of them
+void flow_block(struct FlowField *field, const struct DistanceField *sdf,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max);
+// moves the target, NULL removes it, nothing changes until flow_update
+void flow_set_target(struct FlowField *field, int target, const struct Vec2D *pos);
+// applies the changes, only the cells they affect are computed again
+void flow_update(struct FlowField *field);
+
+// length of the way from pos to the nearest target, false if there is none
+bool flow_distance(const struct FlowField *field, const struct Vec2D *pos, double *dist);
+// direction from pos to a cell up to FLOW_LOOKAHEAD cells ahead on the way
+// to the nearest target, false if there is no way or pos is at the target
+bool flow_direction(const struct FlowField *field, const struct Vec2D *pos, struct Vec2D *dir);
+
+#endif
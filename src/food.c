@@ -0,0 +1,113 @@
+#include "food.h"
+#include "rng.h"
+
+static int food_probability_table[FOOD_END] = {
+	[FRUIT_START] =
+	3, 2, 3, 2, 2, 3,
+	3, 2, 2, 3, 0, 1,
+	3, 0, 1, 3, 3, 2,
+	2, 2, 2, 3, 2, 0,
+	2, 0, 0, 2, 2, 1,
+	2, 3, 0, 3, 3, 1,
+	[VEGE_START] =
+	3, 2, 3, 2, 3, 2,
+	2, 2, 3, 0, 4, 0,
+	3, 0, 3, 2, 3, 0,
+	3, 3, 0, 2, 1, 3,
+	3, 3, 3, 2, 2, 2,
+	3, 2, 2, 3, 3, 3
+};
+
+static int food_probability_sum = 0;
+// alias table of food_probability_table, see food_evaluate_probability,
+// column i gives i below food_alias_threshold[i] out of the sum
+// and food_alias[i] from there on
+static int food_alias_threshold[FOOD_END];
+static enum Food food_alias[FOOD_END];
+
+enum Food get_random_food(struct Rng *rng)
+{
+	return food_pick(rng_int(rng, FOOD_END * food_probability_sum));
+}
+
+void food_lock(void)
+{
+	food_probability_table[FRUIT_CINDERBERRY] = 0;
+	food_probability_table[FRUIT_OREBERRY] = 0;
+	food_probability_table[FRUIT_SOULFRUIT] = 0;
+	food_evaluate_probability();
+}
+
+void food_unlock(void)
+{
+	food_probability_table[FRUIT_CINDERBERRY] = 5;
+	food_probability_table[FRUIT_OREBERRY] = 5;
+	food_probability_table[FRUIT_SOULFRUIT] = 3;
+	food_evaluate_probability();
+}
+
+// Vose's alias method in integers, the weights are scaled by the
+// number of columns so every column holds the sum exactly
+void food_evaluate_probability(void)
+{
+	food_probability_sum = 0;
+	for (int i = 0; i < FOOD_END; ++i)
+	{
+		food_probability_sum += food_probability_table[i];
+	}
+
+	int small[FOOD_END];
+	int large[FOOD_END];
+	int small_num = 0;
+	int large_num = 0;
+	for (int i = 0; i < FOOD_END; ++i)
+	{
+		food_alias_threshold[i] = food_probability_table[i] * FOOD_END;
+		food_alias[i] = (enum Food)i;
+		if (food_alias_threshold[i] < food_probability_sum)
+			small[small_num++] = i;
+		else
+			large[large_num++] = i;
+	}
+	while (small_num > 0 && large_num > 0)
+	{
+		// the rest of the small column is filled from the large one
+		const int l = small[--small_num];
+		const int g = large[--large_num];
+		food_alias[l] = (enum Food)g;
+		food_alias_threshold[g] -= food_probability_sum - food_alias_threshold[l];
+		if (food_alias_threshold[g] < food_probability_sum)
+			small[small_num++] = g;
+		else
+			large[large_num++] = g;
+	}
+	// only the full columns are left
+	while (large_num > 0)
+		food_alias_threshold[large[--large_num]] = food_probability_sum;
+	while (small_num > 0)
+		food_alias_threshold[small[--small_num]] = food_probability_sum;
+}
+
+int food_weight(enum Food food)
+{
+	return food_probability_table[food];
+}
+
+void food_set_weight(enum Food food, int weight)
+{
+	food_probability_table[food] = weight;
+}
+
+int food_weights_sum(void)
+{
+	return food_probability_sum;
+}
+
+// a column and a point within it from a single number
+enum Food food_pick(int number)
+{
+	const int i = number / food_probability_sum;
+	if (number % food_probability_sum < food_alias_threshold[i])
+		return (enum Food)i;
+	return food_alias[i];
+}
@@ -0,0 +1,24 @@
+#ifndef _H_FOOD
+#define _H_FOOD
+
+#include "main.h"
+
+struct Rng;
+
+// one food by the weights of the draw
+enum Food get_random_food(struct Rng *rng);
+// the fruits of the gold mushroom are left out of the draw or put back
+void food_lock(void);
+void food_unlock(void);
+
+// weight of a food in the draw, changes apply on food_evaluate_probability
+int food_weight(enum Food food);
+void food_set_weight(enum Food food, int weight);
+void food_evaluate_probability(void);
+// a draw takes a number below FOOD_END times the sum of the weights
+int food_weights_sum(void);
+// the food the number gives, each comes out weight * FOOD_END times
+// over all the numbers
+enum Food food_pick(int number);
+
+#endif
@@ -2,7 +2,13 @@
 #include "main.h"
 #include "game.h"
 #include "gfx.h"
+#include "workers.h"
+#include "collision.h"
+#include "rng.h"
+#include "food.h"
 #include <math.h>
+#include <string.h>
+#include <time.h>
 
 enum Region
 {
@@ -29,24 +35,71 @@ static int food_grow_table[FOOD_END] = {
 	1, 2, 2, 1, 1, 1
 };
 
-static int food_probability_table[FOOD_END] = {
-	[FRUIT_START] =
-	3, 2, 3, 2, 2, 3,
-	3, 2, 2, 3, 0, 1,
-	3, 0, 1, 3, 3, 2,
-	2, 2, 2, 3, 2, 0,
-	2, 0, 0, 2, 2, 1,
-	2, 3, 0, 3, 3, 1,
-	[VEGE_START] =
-	3, 2, 3, 2, 3, 2,
-	2, 2, 3, 0, 4, 0,
-	3, 0, 3, 2, 3, 0,
-	3, 3, 0, 2, 1, 3,
-	3, 3, 3, 2, 2, 2,
-	3, 2, 2, 3, 3, 3
+// shared data of the per-snake jobs of a single simulation step
+struct StepJob
+{
+	struct Room *room;
+	double dt;
+	bool ai;
+	double plan_budget_us;	// for every planning snake
+};
+
+// decisions of the AI made in the background on snapshots of the room,
+// one is decided on while the other is written
+struct AiAsync
+{
+	struct Room views[2];
+	int front;	// the view decided on
+	bool running;
+	struct StepJob step;	// of the job on the front view
 };
 
-static int food_probability_sum = 0;
+// state of a grid query made by generate_safe_position
+struct SafeQuery
+{
+	const struct Room *room;
+	const struct Vec2D *pos;
+	double dist;
+	bool hit;
+};
+
+// state of a grid query made by snake_sweep
+struct SweepQuery
+{
+	const struct Room *room;
+	const struct Vec2D *from;
+	const struct Vec2D *to;
+	double toi;
+	int index;
+};
+
+// state of a grid query made by snake_sense
+struct SenseQuery
+{
+	const struct Snake *snake;
+	const struct Room *room;
+	struct Sensor *sensor;
+	// bounding box of the points
+	struct Vec2D bb_min;
+	struct Vec2D bb_max;
+};
+
+// state of a grid query made by consumable_nearest
+struct NearestQuery
+{
+	const struct Room *room;
+	const struct Vec2D *pos;
+};
+
+// heads around a planning snake, they are expected to keep going straight
+struct PlanQuery
+{
+	const struct Snake *snake;
+	const struct Room *room;
+	int heads_num;
+	struct Vec2D heads[AI_PLAN_MAX_HEADS];
+	struct Vec2D velocities[AI_PLAN_MAX_HEADS];
+};
 
 static enum SoundType sfx_st = ST_END;
 
@@ -54,9 +107,7 @@ int fps = 0;
 
 struct Camera camera = {
 	.cm = CM_FIXED,
-	.center = NULL,
-	.angle = NULL,
-	.target_angle = NULL
+	.target = NULL
 };
 
 struct Vec2D* vadd(struct Vec2D *dst, const struct Vec2D *elem)
@@ -97,17 +148,55 @@ double vdist(const struct Vec2D *vec1, const struct Vec2D *vec2)
 	return vlen(&diff);
 }
 
+// squared distance, for comparisons only
+double vdist2(const struct Vec2D *vec1, const struct Vec2D *vec2)
+{
+	struct Vec2D diff = *vec1;
+	vsub(&diff, vec2);
+	return vdot(&diff, &diff);
+}
+
+struct Vec2D* vlerp(struct Vec2D *dst, const struct Vec2D *elem, double t)
+{
+	dst->x += (elem->x - dst->x) * t;
+	dst->y += (elem->y - dst->y) * t;
+	return dst;
+}
+
+// interpolation of angles, takes the shorter way around
+double alerp(double from, double to, double t)
+{
+	double diff = to - from;
+	SINCOS_FIX_INC(diff);
+	SINCOS_FIX_DEC(diff);
+	double result = from + diff * t;
+	SINCOS_FIX_INC(result);
+	SINCOS_FIX_DEC(result);
+	return result;
+}
+
 void snake_init(struct Snake *snake)
 {
 	snake->base_v = SNAKE_STARTING_VELOCITY;
 	snake->base_w = SNAKE_STARTING_ANGLE_V;
 	snake->dir = 0.0;
 	snake->len = 1;
+	snake->capacity = SNAKE_INITIAL_CAPACITY;
+	snake->pieces = (struct Vec2D *)malloc(snake->capacity * sizeof(struct Vec2D));
+	snake->prev_pieces = (struct Vec2D *)malloc(snake->capacity * sizeof(struct Vec2D));
+	snake->chunks = (struct BodyChunk *)malloc(BODY_CHUNKS(snake->capacity) * sizeof(struct BodyChunk));
 	snake->pieces[0] = (struct Vec2D) {
 			.x = SCREEN_WIDTH / 2,
 			.y = SCREEN_HEIGHT / 2
 		};
 	snake->turn = TURN_NONE;
+	for (int i = 0; i < AI_PLAN_SEGMENTS; ++i)
+	{
+		snake->plan.turn[i] = TURN_NONE;
+		snake->plan.accelerate[i] = false;
+	}
+	snake->plan.left = AI_PLAN_SEGMENT_TIME;
+	snake->plan.seed = 1;
 	snake->wobbly_freq = 0;
 	snake->wobbly_phase = 0;
 	switch (menu_options[MO_WOBBLINESS])
@@ -120,12 +209,202 @@ void snake_init(struct Snake *snake)
 			break;
 	}
 	snake->skill = SKILL_NONE;
-	snake->skill_timeout = 0;
 	snake->alive = true;
+	snake->grid_head = (struct GridItem) { .type = GI_HEAD, .rect = { .x1 = -1 } };
+	snake->grid_chunks = NULL;
+	snake->grid_chunks_num = 0;
+	snake->grid_chunks_capacity = 0;
+	snake->space_rect = (struct GridRect) { .x1 = -1 };
+	snake_update_bounds(snake);
+	snake_save_state(snake);
+}
+
+void snake_dispose(struct Snake *snake)
+{
+	free(snake->pieces);
+	snake->pieces = NULL;
+	free(snake->prev_pieces);
+	snake->prev_pieces = NULL;
+	snake->capacity = 0;
+	snake->len = 0;
+	free(snake->chunks);
+	snake->chunks = NULL;
+	free(snake->grid_chunks);
+	snake->grid_chunks = NULL;
+	snake->grid_chunks_num = 0;
+	snake->grid_chunks_capacity = 0;
+}
+
+// what the AI reads of the snake, dst keeps pieces of its own
+static void snake_copy(struct Snake *dst, const struct Snake *src)
+{
+	struct Vec2D *pieces = dst->pieces;
+	struct BodyChunk *chunks = dst->chunks;
+	int capacity = dst->capacity;
+	if (capacity < src->len)
+	{
+		capacity = src->capacity;
+		pieces = (struct Vec2D *)realloc(pieces, capacity * sizeof(struct Vec2D));
+		chunks = (struct BodyChunk *)realloc(chunks, BODY_CHUNKS(capacity) * sizeof(struct BodyChunk));
+	}
+	memcpy(pieces, src->pieces, src->len * sizeof(struct Vec2D));
+	memcpy(chunks, src->chunks, BODY_CHUNKS(src->len) * sizeof(struct BodyChunk));
+	*dst = *src;
+	dst->pieces = pieces;
+	dst->chunks = chunks;
+	dst->capacity = capacity;
+	dst->prev_pieces = NULL;
+	dst->grid_chunks = NULL;
+	dst->grid_chunks_num = 0;
+	dst->grid_chunks_capacity = 0;
+}
+
+// the bounding box of the snake from the boxes of its chunks
+static void snake_merge_chunks(struct Snake *snake)
+{
+	snake->bb_min = snake->chunks[0].bb_min;
+	snake->bb_max = snake->chunks[0].bb_max;
+	for (int c = 1; c < BODY_CHUNKS(snake->len); ++c)
+	{
+		snake->bb_min.x = fmin(snake->bb_min.x, snake->chunks[c].bb_min.x);
+		snake->bb_min.y = fmin(snake->bb_min.y, snake->chunks[c].bb_min.y);
+		snake->bb_max.x = fmax(snake->bb_max.x, snake->chunks[c].bb_max.x);
+		snake->bb_max.y = fmax(snake->bb_max.y, snake->chunks[c].bb_max.y);
+	}
+}
+
+void snake_update_bounds(struct Snake *snake)
+{
+	for (int c = 0; c < BODY_CHUNKS(snake->len); ++c)
+	{
+		const int start = c << BODY_CHUNK_SHIFT;
+		const int end = start + BODY_CHUNK_SIZE < snake->len ? start + BODY_CHUNK_SIZE : snake->len;
+		struct BodyChunk *chunk = &snake->chunks[c];
+		chunk->bb_min = snake->pieces[start];
+		chunk->bb_max = snake->pieces[start];
+		for (int i = start + 1; i < end; ++i)
+		{
+			chunk->bb_min.x = fmin(chunk->bb_min.x, snake->pieces[i].x);
+			chunk->bb_min.y = fmin(chunk->bb_min.y, snake->pieces[i].y);
+			chunk->bb_max.x = fmax(chunk->bb_max.x, snake->pieces[i].x);
+			chunk->bb_max.y = fmax(chunk->bb_max.y, snake->pieces[i].y);
+		}
+	}
+	snake_merge_chunks(snake);
+}
+
+// cheap rejection test - can any piece be closer than margin to pos?
+bool snake_is_near(const struct Snake *snake, const struct Vec2D *pos, double margin)
+{
+	return pos->x > snake->bb_min.x - margin && pos->x < snake->bb_max.x + margin &&
+		pos->y > snake->bb_min.y - margin && pos->y < snake->bb_max.y + margin;
+}
+
+// registers the head and the body samples as they are now,
+// dead snakes are removed from the grid
+void snake_grid_sync(struct Snake *snake, struct Grid *grid)
+{
+	if (!snake->alive)
+	{
+		grid_update(grid, &snake->grid_head, NULL);
+		for (int k = 0; k < snake->grid_chunks_num; ++k)
+		{
+			grid_update(grid, &snake->grid_chunks[k], NULL);
+		}
+		return;
+	}
+
+	struct GridRect rect = grid_rect(grid, &snake->pieces[0], HEAD_RADIUS);
+	grid_update(grid, &snake->grid_head, &rect);
+
+	const int num = snake->len > 1 ? BODY_CHUNKS(snake->len) : 0;
+	if (num > snake->grid_chunks_capacity)
+	{
+		while (snake->grid_chunks_capacity < num)
+			snake->grid_chunks_capacity = snake->grid_chunks_capacity ?
+				snake->grid_chunks_capacity * 2 : 16;
+		snake->grid_chunks = (struct GridItem *)realloc(snake->grid_chunks,
+			snake->grid_chunks_capacity * sizeof(struct GridItem));
+	}
+	for (int c = snake->grid_chunks_num; c < num; ++c)
+	{
+		snake->grid_chunks[c] = (struct GridItem) {
+			.type = GI_BODY,
+			.owner = snake->grid_head.owner,
+			.index = c,
+			.rect = { .x1 = -1 }
+		};
+	}
+	if (num > snake->grid_chunks_num)
+		snake->grid_chunks_num = num;
+
+	for (int c = 0; c < num; ++c)
+	{
+		const struct Vec2D bb_min = {
+			.x = snake->chunks[c].bb_min.x - BODY_RADIUS,
+			.y = snake->chunks[c].bb_min.y - BODY_RADIUS
+		};
+		const struct Vec2D bb_max = {
+			.x = snake->chunks[c].bb_max.x + BODY_RADIUS,
+			.y = snake->chunks[c].bb_max.y + BODY_RADIUS
+		};
+		rect = grid_box(grid, &bb_min, &bb_max);
+		grid_update(grid, &snake->grid_chunks[c], &rect);
+	}
+	for (int c = num; c < snake->grid_chunks_num; ++c)
+	{
+		grid_update(grid, &snake->grid_chunks[c], NULL);
+	}
+}
+
+// no food appears around the head of a living snake
+void snake_space_sync(struct Snake *snake, struct FreeSpace *space)
+{
+	if (!snake->alive)
+	{
+		space_update(space, &snake->space_rect, NULL);
+		return;
+	}
+	const double reach = CONSUMABLE_SAFE_DISTANCE;
+	const struct Vec2D bb_min = { .x = snake->pieces[0].x - reach, .y = snake->pieces[0].y - reach };
+	const struct Vec2D bb_max = { .x = snake->pieces[0].x + reach, .y = snake->pieces[0].y + reach };
+	struct GridRect rect = space_box(space, &bb_min, &bb_max);
+	space_update(space, &snake->space_rect, &rect);
+}
+
+// the sampled pieces of a chunk are len-1, len-1-PIECE_DRAW_INCREMENT...
+// within the chunk and above until, returns the first one to be passed
+// to points_first_hit with the other bound in *last
+static int snake_chunk_samples(const struct Snake *snake, int chunk, int until, int *last)
+{
+	int end = (chunk + 1) << BODY_CHUNK_SHIFT;
+	if (end > snake->len)
+		end = snake->len;
+	const int skip = (snake->len - end + PIECE_DRAW_INCREMENT - 1) / PIECE_DRAW_INCREMENT;
+	const int start = (chunk << BODY_CHUNK_SHIFT) - 1;
+	*last = start > until ? start : until;
+	return snake->len - 1 - skip * PIECE_DRAW_INCREMENT;
+}
+
+// is pos closer than margin to the chunk?
+static bool snake_chunk_is_near(const struct Snake *snake, int chunk, const struct Vec2D *pos, double margin)
+{
+	const struct BodyChunk *c = &snake->chunks[chunk];
+	return pos->x > c->bb_min.x - margin && pos->x < c->bb_max.x + margin &&
+		pos->y > c->bb_min.y - margin && pos->y < c->bb_max.y + margin;
+}
+
+void snake_save_state(struct Snake *snake)
+{
+	snake->prev_dir = snake->dir;
+	snake->prev_len = snake->len;
+	memcpy(snake->prev_pieces, snake->pieces, snake->len * sizeof(struct Vec2D));
 }
 
 void snake_process(struct Snake *snake, double dt)
 {
+	snake_save_state(snake);
+
 	// control processing
 	switch (snake->turn)
 	{
@@ -151,33 +430,43 @@ void snake_process(struct Snake *snake, double dt)
 	};
 	vadd(&snake->pieces[0], &offset);
 
-	// tail calculation
-	for (int i = 1; i < snake->len; ++i)
+	// tail calculation, chunk by chunk
+	for (int c = 0; c < BODY_CHUNKS(snake->len); ++c)
 	{
-		struct Vec2D diff;
-		diff = snake->pieces[i-1];
-		vsub(&diff, &snake->pieces[i]);
-		double dlen = vlen(&diff);
-		if (dlen > PIECE_DISTANCE)
+		const int start = c << BODY_CHUNK_SHIFT;
+		const int end = start + BODY_CHUNK_SIZE < snake->len ? start + BODY_CHUNK_SIZE : snake->len;
+		int i = start;
+		struct Vec2D bb_min = { .x = INFINITY, .y = INFINITY };
+		struct Vec2D bb_max = { .x = -INFINITY, .y = -INFINITY };
+		if (0 == i)
 		{
-			vmul(&diff, (dlen - PIECE_DISTANCE) / dlen);
-			vadd(&snake->pieces[i], &diff);
+			// the head is already there
+			bb_min = bb_max = snake->pieces[0];
+			++i;
 		}
-	}
-
-	// skill timeout
-	if (snake->skill_timeout > 0)
-	{
-		snake->skill_timeout -= dt;
-		if (snake->skill_timeout < 0)
+		for (; i < end; ++i)
 		{
-			snake->skill = SKILL_NONE;
-			snake->skill_timeout = 0;
+			struct Vec2D diff;
+			diff = snake->pieces[i-1];
+			vsub(&diff, &snake->pieces[i]);
+			double dlen = vlen(&diff);
+			if (dlen > PIECE_DISTANCE)
+			{
+				vmul(&diff, (dlen - PIECE_DISTANCE) / dlen);
+				vadd(&snake->pieces[i], &diff);
+			}
+			bb_min.x = fmin(bb_min.x, snake->pieces[i].x);
+			bb_min.y = fmin(bb_min.y, snake->pieces[i].y);
+			bb_max.x = fmax(bb_max.x, snake->pieces[i].x);
+			bb_max.y = fmax(bb_max.y, snake->pieces[i].y);
 		}
+		snake->chunks[c].bb_min = bb_min;
+		snake->chunks[c].bb_max = bb_max;
 	}
+	snake_merge_chunks(snake);
 }
 
-void snake_draw(const struct Snake *snake)
+void snake_draw(const struct Snake *snake, double alpha)
 {
 	Uint32 black = SDLGFX_COLOR(0, 0, 0);
 	SDL_Rect dst;
@@ -185,8 +474,14 @@ void snake_draw(const struct Snake *snake)
 	// body
 	for (int i = snake->len - 1; i > 0; i -= PIECE_DRAW_INCREMENT)
 	{
-		double x = snake->pieces[i].x;
-		double y = snake->pieces[i].y;
+		struct Vec2D pos = snake->pieces[i];
+		if (i < snake->prev_len)
+		{
+			pos = snake->prev_pieces[i];
+			vlerp(&pos, &snake->pieces[i], alpha);
+		}
+		double x = pos.x;
+		double y = pos.y;
 		camera_convert(&x, &y);
 		dst.x = x - SNAKE_PART_SIZE / 2;
 		dst.y = y - SNAKE_PART_SIZE / 2;
@@ -194,12 +489,15 @@ void snake_draw(const struct Snake *snake)
 	}
 
 	// head
-	double x = snake->pieces[0].x;
-	double y = snake->pieces[0].y;
+	struct Vec2D pos = snake->prev_pieces[0];
+	vlerp(&pos, &snake->pieces[0], alpha);
+	double x = pos.x;
+	double y = pos.y;
 	camera_convert(&x, &y);
 	dst.x = x - SNAKE_PART_SIZE / 2;
 	dst.y = y - SNAKE_PART_SIZE / 2;
-	double head_angle = snake->dir - *camera.angle + (M_PI / ROT_ANGLE_COUNT);
+	double dir = alerp(snake->prev_dir, snake->dir, alpha);
+	double head_angle = dir - camera.angle + (M_PI / ROT_ANGLE_COUNT);
 	while (head_angle < 0)
 		head_angle += 2 * M_PI;
 	int head_sprite_no = ROT_ANGLE_COUNT * head_angle / (2 * M_PI);
@@ -237,139 +535,445 @@ void snake_control(struct Snake *snake)
 	}
 }
 
-void snake_ai_dumb_control(struct Snake *snake, const struct Room *room)
+// whether the box grown by dist may cover any of the points
+static bool sense_box_is_near(const struct SenseQuery *query,
+	const struct Vec2D *bb_min, const struct Vec2D *bb_max, double dist)
 {
-	// "eyes"
-	struct Vec2D eyes[AI_DUMB_EYES_NUM];
-	for (int i = 0; i < AI_DUMB_EYES_NUM; ++i)
-	{
-		sincos(snake->dir - M_PI_2 + (M_PI * i) / AI_DUMB_EYES_NUM, &eyes[i].x, &eyes[i].y);
-		eyes[i].y = -eyes[i].y;
-		vadd(vmul(&eyes[i], AI_DUMB_VISION_RANGE), &snake->pieces[0]);
-	}
+	return query->bb_min.x < bb_max->x + dist && query->bb_max.x > bb_min->x - dist &&
+		query->bb_min.y < bb_max->y + dist && query->bb_max.y > bb_min->y - dist;
+}
 
-	int leftd = 0;
-	int rightd = 0;
-	if (snake->skill != SKILL_GHOST && snake->skill != SKILL_ONIX)
-	{
-		for (int i = 0; i < room->obstacles_num; ++i)
+// adds what the item covers to the points
+static bool snake_sense_visit(const struct GridItem *item, void *data)
+{
+	const struct SenseQuery *query = data;
+	const struct Snake *snake = query->snake;
+	const struct Room *room = query->room;
+	struct Sensor *sensor = query->sensor;
+	const int num = sensor->num;
+	switch (item->type)
+	{
+		case GI_OBSTACLE:
 		{
-			if (!room->obstacles[i].valid)
-				continue;
-			for (int j = 0; j < AI_DUMB_EYES_NUM / 2; ++j)
+			const struct Obstacle *obstacle = &room->obstacles[item->index];
+			if (!obstacle->valid ||
+				!sense_box_is_near(query, &obstacle->segment.pos, &obstacle->segment.pos, obstacle->segment.r))
+				break;
+			circle_mark_points(&obstacle->segment.pos, obstacle->segment.r,
+				sensor->points, sensor->hits, num);
+		} break;
+		case GI_WALL:
+		{
+			const struct Wall *wall = &room->walls[item->index];
+			if (!sense_box_is_near(query, &wall->bb_min, &wall->bb_max, wall->r))
+				break;
+			for (int g = 0; g < num; ++g)
 			{
-				if (vdist(&room->obstacles[i].segment.pos, &eyes[j]) <
-					room->obstacles[i].segment.r)
-					++leftd;
+				struct Vec2D wd = wall_dist(wall, &sensor->points[g]);
+				sensor->hits[g] += vec_within(&wd, wall->r);
 			}
-			for (int j = AI_DUMB_EYES_NUM / 2; j < AI_DUMB_EYES_NUM; ++j)
+		} break;
+		case GI_HEAD:
+		{
+			const struct Snake *other = &room->snake[item->owner];
+			// the head counts only when the samples reach it
+			if (other == snake || !other->alive || other->skill == SKILL_GHOST ||
+				(other->len - 1) % PIECE_DRAW_INCREMENT != 0 ||
+				!sense_box_is_near(query, &other->pieces[0], &other->pieces[0], BODY_RADIUS + sensor->body_margin))
+				break;
+			circle_mark_points(&other->pieces[0], BODY_RADIUS + sensor->body_margin,
+				sensor->points, sensor->hits, num);
+		} break;
+		case GI_BODY:
+		{
+			const struct Snake *other = &room->snake[item->owner];
+			int until = 0;
+			if (other == snake)
 			{
-				if (vdist(&room->obstacles[i].segment.pos, &eyes[j]) <
-					room->obstacles[i].segment.r)
-					++rightd;
+				if (snake->skill == SKILL_UROBOROS)
+					break;
+				until = START_LEN + 1;
 			}
-		}
-	}
-	if (snake->skill != SKILL_GHOST)
-	{
-		for (int i = 0; i < room->walls_num; ++i)
-		{
-			for (int j = 0; j < AI_DUMB_EYES_NUM / 2; ++j)
+			else if (!other->alive || other->skill == SKILL_GHOST)
 			{
-				struct Vec2D *wd = wall_dist(&room->walls[i], &eyes[j]);
-				if (vlen(wd) < room->walls[i].r)
-					++leftd;
+				break;
 			}
-			for (int j = AI_DUMB_EYES_NUM / 2; j < AI_DUMB_EYES_NUM; ++j)
+			const double dist = BODY_RADIUS + sensor->body_margin;
+			const struct BodyChunk *chunk = &other->chunks[item->index];
+			if (!sense_box_is_near(query, &chunk->bb_min, &chunk->bb_max, dist))
+				break;
+			int last;
+			int i = snake_chunk_samples(other, item->index, until, &last);
+			for (; i > last; i -= PIECE_DRAW_INCREMENT)
 			{
-				struct Vec2D *wd = wall_dist(&room->walls[i], &eyes[j]);
-				if (vlen(wd) < room->walls[i].r)
-					++rightd;
+				const struct Vec2D *piece = &other->pieces[i];
+				if (!sense_box_is_near(query, piece, piece, dist))
+					continue;
+				circle_mark_points(piece, dist, sensor->points, sensor->hits, num);
 			}
-		}
+		} break;
 	}
-	if (snake->skill != SKILL_GHOST && snake->skill != SKILL_UROBOROS)
+	return true;
+}
+
+// counts the things covering every point, the points are answered
+// together by a single query of the grid
+void snake_sense(const struct Snake *snake, const struct Room *room, struct Sensor *sensor)
+{
+	struct Vec2D bb_min = sensor->points[0];
+	struct Vec2D bb_max = sensor->points[0];
+	// plain comparisons, fmin and fmax are calls unless the math is relaxed
+	for (int i = 0; i < sensor->num; ++i)
+	{
+		const struct Vec2D *p = &sensor->points[i];
+		sensor->hits[i] = 0;
+		if (p->x < bb_min.x)
+			bb_min.x = p->x;
+		if (p->x > bb_max.x)
+			bb_max.x = p->x;
+		if (p->y < bb_min.y)
+			bb_min.y = p->y;
+		if (p->y > bb_max.y)
+			bb_max.y = p->y;
+	}
+	struct SenseQuery query = {
+		.snake = snake,
+		.room = room,
+		.sensor = sensor,
+		.bb_min = bb_min,
+		.bb_max = bb_max
+	};
+	grid_query_box(&room->grid, &bb_min, &bb_max, sensor->mask, snake_sense_visit, &query);
+}
+
+void snake_ai_dumb_control(struct Snake *snake, const struct Room *room)
+{
+	snake_ai_dumb_batch(&snake, 1, room);
+}
+
+// the snakes are taken AI_DUMB_BATCH at a time: the eyes of each one go
+// through the lanes together, then the turns are set
+void snake_ai_dumb_batch(struct Snake *const snakes[], int num, const struct Room *room)
+{
+	for (int first = 0; first < num; first += AI_DUMB_BATCH)
 	{
-		for (int i = snake->len - 1; i > START_LEN + 1; i -= PIECE_DRAW_INCREMENT)
+		struct Snake *const *batch = &snakes[first];
+		const int count = num - first < AI_DUMB_BATCH ? num - first : AI_DUMB_BATCH;
+		struct Vec2D dirvec[AI_DUMB_BATCH];
+		bool follow[AI_DUMB_BATCH];
+
+		for (int k = 0; k < count; ++k)
 		{
-			for (int j = 0; j < AI_DUMB_EYES_NUM / 2; ++j)
+			struct Snake *snake = batch[k];
+			// "eyes"
+			struct Sensor sensor = {
+				.num = AI_DUMB_EYES_NUM,
+				.mask = 0,
+				.body_margin = AI_DUMB_DETECTION_MARGIN
+			};
+			for (int i = 0; i < AI_DUMB_EYES_NUM; ++i)
+			{
+				struct Vec2D *eye = &sensor.points[i];
+				sincos(snake->dir - M_PI_2 + (M_PI * i) / AI_DUMB_EYES_NUM, &eye->x, &eye->y);
+				eye->y = -eye->y;
+				vadd(vmul(eye, AI_DUMB_VISION_RANGE), &snake->pieces[0]);
+			}
+
+			if (snake->skill != SKILL_GHOST)
+				sensor.mask |= GRID_MASK(GI_WALL) | GRID_MASK(GI_HEAD) | GRID_MASK(GI_BODY);
+			if (snake->skill != SKILL_GHOST && snake->skill != SKILL_ONIX)
+				sensor.mask |= GRID_MASK(GI_OBSTACLE);
+			// no eye can be inside the static geometry
+			if (sdf_lower_bound(&room->sdf, &snake->pieces[0]) >= AI_DUMB_VISION_RANGE)
+				sensor.mask &= ~(GRID_MASK(GI_WALL) | GRID_MASK(GI_OBSTACLE));
+			snake_sense(snake, room, &sensor);
+
+			int leftd = 0;
+			int rightd = 0;
+			for (int i = 0; i < AI_DUMB_EYES_NUM / 2; ++i)
+			{
+				leftd += sensor.hits[i];
+				rightd += sensor.hits[i + AI_DUMB_EYES_NUM / 2];
+			}
+
+			snake->turn = TURN_NONE;
+			follow[k] = false;
+			if (leftd > rightd)
 			{
-				if (vdist(&snake->pieces[i], &eyes[j]) < (BODY_RADIUS + AI_DUMB_DETECTION_MARGIN))
-					++leftd;
+				snake->turn = TURN_RIGHT;
 			}
-			for (int j = AI_DUMB_EYES_NUM / 2; j < AI_DUMB_EYES_NUM; ++j)
+			else if (rightd > leftd)
 			{
-				if (vdist(&snake->pieces[i], &eyes[j]) < (BODY_RADIUS + AI_DUMB_DETECTION_MARGIN))
-					++rightd;
+				snake->turn = TURN_LEFT;
+			}
+			else
+			{
+				// follow the way around the walls to the nearest food,
+				// straight at it when it is there already or out of reach
+				follow[k] = true;
+				if (!flow_direction(&room->flow, &snake->pieces[0], &dirvec[k]))
+				{
+					dirvec[k] = room->consumables[consumable_nearest(room, &snake->pieces[0])].segment.pos;
+					vsub(&dirvec[k], &snake->pieces[0]);
+				}
 			}
 		}
-	}
-	if (snake->skill != SKILL_GHOST)
-	{
-		for (int k = 0; k < SNAKE_NUM; ++k)
-		{
-			if ((snake == &room->snake[k]) ||
-				(room->snake[k].skill == SKILL_GHOST)) continue;
 
-			for (int i = snake->len - 1; i >= 0; i -= PIECE_DRAW_INCREMENT)
+		for (int k = 0; k < count; ++k)
+		{
+			struct Snake *snake = batch[k];
+			if (follow[k])
 			{
-				for (int j = 0; j < AI_DUMB_EYES_NUM / 2; ++j)
+				// adjust direction
+				double ddiff = atan2(dirvec[k].y, dirvec[k].x) + M_PI_2 - snake->dir;
+				SINCOS_FIX_INC(ddiff);
+				SINCOS_FIX_DEC(ddiff);
+
+				if (ddiff > 0)
 				{
-					if (vdist(&room->snake[k].pieces[i], &eyes[j]) < (BODY_RADIUS + AI_DUMB_DETECTION_MARGIN))
-						++leftd;
+					snake->turn = TURN_RIGHT;
 				}
-				for (int j = AI_DUMB_EYES_NUM / 2; j < AI_DUMB_EYES_NUM; ++j)
+				else
 				{
-					if (vdist(&room->snake[k].pieces[i], &eyes[j]) < (BODY_RADIUS + AI_DUMB_DETECTION_MARGIN))
-						++rightd;
+					snake->turn = TURN_LEFT;
 				}
 			}
+
+			snake->v = snake->base_v;
+			snake->w = snake->base_w;
 		}
 	}
+}
 
-	snake->turn = TURN_NONE;
-	if (leftd > rightd)
+// microseconds from an arbitrary point, never going back
+static double ai_clock_us(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1e6 + now.tv_nsec * 1e-3;
+}
+
+// xorshift of every snake, the planners run in parallel so they do not
+// share the generators of the room
+static unsigned int ai_plan_random(struct AiPlan *plan)
+{
+	unsigned int x = plan->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return plan->seed = x;
+}
+
+// how good the plan is, higher is better: the snake is moved along it
+// with the room frozen, a crash loses to anything that does not crash
+// and otherwise the nearer it gets to the food the better
+static double ai_plan_score(const struct PlanQuery *query, const struct AiPlan *plan)
+{
+	const struct Snake *snake = query->snake;
+	const struct Room *room = query->room;
+	const bool ghost = SKILL_GHOST == snake->skill;
+	struct Sensor sensor = {
+		.num = 0,
+		.mask = ghost ? 0 : GRID_MASK(GI_HEAD) | GRID_MASK(GI_BODY),
+		.body_margin = HEAD_RADIUS
+	};
+	double flow[SENSOR_MAX_POINTS];
+	bool flow_found[SENSOR_MAX_POINTS];
+	struct Vec2D pos = snake->pieces[0];
+	double dir = snake->dir;
+	double phase = snake->wobbly_phase;
+	double t = 0;
+	double end = plan->left;
+	int move = 0;
+	int accelerated = 0;
+	bool crash = false;
+	while (move < AI_PLAN_SEGMENTS && sensor.num < SENSOR_MAX_POINTS)
+	{
+		const double v = snake->base_v * (plan->accelerate[move] ? SNAKE_V_MULTIPLIER : 1);
+		const double w = snake->base_w * (plan->accelerate[move] ? SNAKE_W_MULTIPLIER : 1);
+		if (TURN_LEFT == plan->turn[move])
+			dir -= w * AI_PLAN_DT;
+		else if (TURN_RIGHT == plan->turn[move])
+			dir += w * AI_PLAN_DT;
+		phase += 2 * M_PI * snake->wobbly_freq * AI_PLAN_DT;
+		struct Vec2D heading;
+		sincos(dir + 0.5 * sin(phase), &heading.x, &heading.y);
+		pos.x += v * heading.x * AI_PLAN_DT;
+		pos.y -= v * heading.y * AI_PLAN_DT;
+		t += AI_PLAN_DT;
+		// the walls, the obstacles and the heads coming are checked
+		// on the way...
+		if (!ghost && sdf_lower_bound(&room->sdf, &pos) < HEAD_RADIUS)
+		{
+			crash = true;
+			break;
+		}
+		for (int i = 0; i < query->heads_num; ++i)
+		{
+			// the body follows the head, so the whole way it has made
+			// until then is in the way
+			struct Vec2D head = query->velocities[i];
+			vadd(vmul(&head, t), &query->heads[i]);
+			if (sweep_circle(&query->heads[i], &head, &pos, 2 * HEAD_RADIUS + AI_DUMB_DETECTION_MARGIN) >= 0)
+				crash = true;
+		}
+		if (crash)
+			break;
+		flow_found[sensor.num] = flow_distance(&room->flow, &pos, &flow[sensor.num]);
+		sensor.points[sensor.num++] = pos;
+		if (t >= end)
+		{
+			accelerated += plan->accelerate[move];
+			end += AI_PLAN_SEGMENT_TIME;
+			++move;
+		}
+	}
+
+	// ...and the snakes all at once
+	int reached = sensor.num;
+	if (sensor.mask && sensor.num > 0)
 	{
-		snake->turn = TURN_RIGHT;
+		snake_sense(snake, room, &sensor);
+		for (int i = 0; i < sensor.num; ++i)
+		{
+			if (sensor.hits[i])
+			{
+				reached = i;
+				crash = true;
+				break;
+			}
+		}
 	}
-	else if (rightd > leftd)
+	if (crash)
+		return -1e6 + reached * AI_PLAN_DT;
+
+	// with no way to any food the distance counts for nothing
+	double nearest = 0;
+	bool found = flow_distance(&room->flow, &snake->pieces[0], &nearest);
+	for (int i = 0; i < reached; ++i)
 	{
-		snake->turn = TURN_LEFT;
+		if (flow_found[i] && (!found || flow[i] < nearest))
+		{
+			nearest = flow[i];
+			found = true;
+		}
+	}
+	// speeding is taken only when it pays off
+	return -nearest - accelerated;
+}
+
+// one move of the plan is changed, sometimes the ones after it too
+static void ai_plan_mutate(struct AiPlan *plan)
+{
+	const int k = ai_plan_random(plan) % AI_PLAN_SEGMENTS;
+	const int last = ai_plan_random(plan) % 2 ? k : AI_PLAN_SEGMENTS - 1;
+	const enum Turn turn = ai_plan_random(plan) % 3;
+	const bool accelerate = ai_plan_random(plan) % 2;
+	for (int i = k; i <= last; ++i)
+	{
+		plan->turn[i] = turn;
+		plan->accelerate[i] = accelerate;
+	}
+}
+
+// keeps the nearest heads of the other snakes
+static bool ai_plan_heads_visit(const struct GridItem *item, void *data)
+{
+	struct PlanQuery *query = data;
+	const struct Snake *other = &query->room->snake[item->owner];
+	if (other == query->snake || !other->alive || SKILL_GHOST == other->skill)
+		return true;
+	const double dist = vdist2(&other->pieces[0], &query->snake->pieces[0]);
+	int i = query->heads_num;
+	if (query->heads_num < AI_PLAN_MAX_HEADS)
+	{
+		++query->heads_num;
 	}
 	else
 	{
-		// find the nearest food
-		int idx = 0;
-		double min_dist = vdist(&snake->pieces[0], &room->consumables[0].segment.pos);
-		for (int i = 1; i < room->consumables_num; ++i)
+		// the farthest one gives way
+		int far = 0;
+		for (int k = 1; k < query->heads_num; ++k)
 		{
-			double dist = vdist(&snake->pieces[0], &room->consumables[i].segment.pos);
-			if (dist < min_dist)
-			{
-				idx = i;
-				min_dist = dist;
-			}
+			if (vdist2(&query->heads[k], &query->snake->pieces[0]) >
+				vdist2(&query->heads[far], &query->snake->pieces[0]))
+				far = k;
 		}
+		if (vdist2(&query->heads[far], &query->snake->pieces[0]) <= dist)
+			return true;
+		i = far;
+	}
+	query->heads[i] = other->pieces[0];
+	query->velocities[i] = (struct Vec2D) {
+		.x = other->v * sin(other->dir),
+		.y = -other->v * cos(other->dir)
+	};
+	return true;
+}
 
-		// adjust direction
-		struct Vec2D dirvec = room->consumables[idx].segment.pos;
-		vsub(&dirvec, &snake->pieces[0]);
-		double ddiff = atan2(dirvec.y, dirvec.x) + M_PI_2 - snake->dir;
-		SINCOS_FIX_INC(ddiff);
-		SINCOS_FIX_DEC(ddiff);
+// anytime search over the moves, it keeps improving the plan of the
+// previous step while there is budget left
+void snake_ai_plan_control(struct Snake *snake, const struct Room *room, double dt, double budget_us)
+{
+	const double start = ai_clock_us();
+	struct AiPlan *plan = &snake->plan;
+	struct PlanQuery query = {
+		.snake = snake,
+		.room = room,
+		.heads_num = 0
+	};
+	if (SKILL_GHOST != snake->skill)
+	{
+		// both could be speeding head to head
+		const double reach = 2 * snake->base_v * SNAKE_V_MULTIPLIER * AI_PLAN_SEGMENTS * AI_PLAN_SEGMENT_TIME;
+		grid_query_circle(&room->grid, &snake->pieces[0], reach,
+			GRID_MASK(GI_HEAD), ai_plan_heads_visit, &query);
+	}
+	plan->left -= dt;
+	while (plan->left <= 0)
+	{
+		for (int i = 1; i < AI_PLAN_SEGMENTS; ++i)
+		{
+			plan->turn[i - 1] = plan->turn[i];
+			plan->accelerate[i - 1] = plan->accelerate[i];
+		}
+		plan->left += AI_PLAN_SEGMENT_TIME;
+	}
 
-		if (ddiff > 0)
+	double best = ai_plan_score(&query, plan);
+	for (int tries = 0; tries < AI_PLAN_MIN_TRIES || ai_clock_us() - start < budget_us; ++tries)
+	{
+		struct AiPlan candidate = *plan;
+		if (tries < AI_PLAN_MIN_TRIES)
 		{
-			snake->turn = TURN_RIGHT;
+			// every move kept all the way first
+			for (int i = 0; i < AI_PLAN_SEGMENTS; ++i)
+			{
+				candidate.turn[i] = tries % 3;
+				candidate.accelerate[i] = tries / 3;
+			}
 		}
 		else
 		{
-			snake->turn = TURN_LEFT;
+			ai_plan_mutate(&candidate);
+		}
+		plan->seed = candidate.seed;
+		const double score = ai_plan_score(&query, &candidate);
+		if (score > best)
+		{
+			best = score;
+			*plan = candidate;
 		}
 	}
 
+	snake->turn = plan->turn[0];
 	snake->v = snake->base_v;
 	snake->w = snake->base_w;
+	if (plan->accelerate[0])
+	{
+		snake->v *= SNAKE_V_MULTIPLIER;
+		snake->w *= SNAKE_W_MULTIPLIER;
+	}
 }
 
 void snake_add_segments(struct Snake *snake, int count)
@@ -380,10 +984,24 @@ void snake_add_segments(struct Snake *snake, int count)
 	{
 		snake->len = MAX_SNAKE_LEN;
 	}
+	if (snake->len > snake->capacity)
+	{
+		while (snake->capacity < snake->len)
+			snake->capacity *= 2;
+		if (snake->capacity > MAX_SNAKE_LEN)
+			snake->capacity = MAX_SNAKE_LEN;
+		snake->pieces = (struct Vec2D *)realloc(snake->pieces,
+			snake->capacity * sizeof(struct Vec2D));
+		snake->prev_pieces = (struct Vec2D *)realloc(snake->prev_pieces,
+			snake->capacity * sizeof(struct Vec2D));
+		snake->chunks = (struct BodyChunk *)realloc(snake->chunks,
+			BODY_CHUNKS(snake->capacity) * sizeof(struct BodyChunk));
+	}
 	for (int i = start; i < snake->len; ++i)
 	{
 		snake->pieces[i] = snake->pieces[start - 1];
 	}
+	snake_update_bounds(snake);
 }
 
 void snake_remove_segments(struct Snake *snake, int count)
@@ -396,21 +1014,44 @@ void snake_remove_segments(struct Snake *snake, int count)
 	}
 }
 
+static int compare_ints(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
 void snake_eat_consumables(struct Snake *snake, struct Room *room)
 {
-	for (int i = 0; i < room->consumables_num; ++i)
+	// everything that can be eaten is found first, the meals are
+	// served in the order of the consumables
+	const struct GridCell *cell = grid_cell(&room->grid, &snake->pieces[0]);
+	int num = 0;
+	for (int k = 0; k < cell->num; ++k)
 	{
-		struct Vec2D diff = snake->pieces[0];
-		vsub(&diff, &room->consumables[i].segment.pos);
-		if (vlen(&diff) < (HEAD_RADIUS + room->consumables[i].segment.r - EAT_DEPTH))
-		{
-			snake_apply_effects(snake, room->consumables[i].type);
-			consumable_generate(&room->consumables[i], room);
-		}
+		if (GI_CONSUMABLE != cell->items[k].type)
+			continue;
+		const struct Segment *seg = &room->consumables[cell->items[k].index].segment;
+		if (circle_hit(&snake->pieces[0], &seg->pos, seg->r + HEAD_RADIUS - EAT_DEPTH))
+			room->eaten[num++] = cell->items[k].index;
+	}
+	if (num > 1)
+		qsort(room->eaten, num, sizeof(int), compare_ints);
+	for (int k = 0; k < num; ++k)
+	{
+		struct Consumable *col = &room->consumables[room->eaten[k]];
+		snake_apply_effects(snake, col->type, room);
+		consumable_generate(col, room);
+		consumable_grid_sync(col, &room->grid);
 	}
 }
 
-static void snake_apply_effects(struct Snake *snake, enum Food food)
+// the skill is taken away after the given number of seconds
+static void snake_give_skill(struct Snake *snake, struct Room *room, enum SkillType skill, int seconds)
+{
+	snake->skill = skill;
+	timer_set(&room->timers, room->consumables_num + snake->grid_head.owner, seconds * SIM_FREQUENCY);
+}
+
+static void snake_apply_effects(struct Snake *snake, enum Food food, struct Room *room)
 {
 	int grow = food_grow_table[food];
 	if (grow >= 0)
@@ -434,13 +1075,11 @@ static void snake_apply_effects(struct Snake *snake, enum Food food)
 		case FRUIT_METALBERRY:
 			speed = -2;
 			sfx_set(ST_ONIX);
-			snake->skill = SKILL_ONIX;
-			snake->skill_timeout = 15;
+			snake_give_skill(snake, room, SKILL_ONIX, 15);
 			break;
 		case FRUIT_SOULFRUIT:
 			sfx_set(ST_GHOST);
-			snake->skill = SKILL_GHOST;
-			snake->skill_timeout = 30;
+			snake_give_skill(snake, room, SKILL_GHOST, 30);
 			break;
 		case FRUIT_CINDERBERRY:
 			speed = 4;
@@ -471,21 +1110,19 @@ static void snake_apply_effects(struct Snake *snake, enum Food food)
 			snake->wobbly_phase = 0;
 			break;
 		case VEGE_SHROOM2:
-			snake->wobbly_freq = 0.8 * (rand() % 3 + 1);
+			snake->wobbly_freq = 0.8 * (rng_int(&room->food_rng, 3) + 1);
 			break;
 		case VEGE_SHROOM3:
 			speed = -2;
 			break;
 		case VEGE_DEVILS_LETTUCE:
 			sfx_set(ST_BITE);
-			snake->skill = SKILL_UROBOROS;
-			snake->skill_timeout = 60;
+			snake_give_skill(snake, room, SKILL_UROBOROS, 60);
 			break;
 		case VEGE_GHOST_PEPPER:
 			speed = 4;
 			sfx_set(ST_GHOST);
-			snake->skill = SKILL_GHOST;
-			snake->skill_timeout = 30;
+			snake_give_skill(snake, room, SKILL_GHOST, 30);
 			break;
 		case VEGE_GOLD_MUSHROOM:
 			sfx_set(ST_UNLOCK);
@@ -509,82 +1146,219 @@ static void snake_apply_effects(struct Snake *snake, enum Food food)
 	}
 }
 
-bool snake_check_selfcollision(struct Snake *snake)
+// (re)computes the distances within the clipping box, NULL for all
+static void room_sdf_stamp(struct Room *room, const struct Vec2D *clip_min, const struct Vec2D *clip_max)
 {
-	if (SKILL_GHOST == snake->skill)
-		return false;
-
-	for (int i = snake->len - 1; i > START_LEN + 1; i -= PIECE_DRAW_INCREMENT)
+	for (int i = 0; i < room->walls_num; ++i)
+	{
+		sdf_add_wall(&room->sdf, &room->walls[i], clip_min, clip_max);
+	}
+	for (int i = 0; i < room->obstacles_num; ++i)
 	{
-		struct Vec2D diff = snake->pieces[0];
-		vsub(&diff, &snake->pieces[i]);
-		if (vlen(&diff) < (HEAD_RADIUS + BODY_RADIUS))
+		if (room->obstacles[i].valid)
+			sdf_add_circle(&room->sdf, &room->obstacles[i].segment, clip_min, clip_max);
+	}
+}
+
+// the cells inside the clipping box are opened if they are in the area
+// of the food and every point of them is far enough from the geometry
+static void room_space_open(struct Room *room, const struct Vec2D *clip_min, const struct Vec2D *clip_max)
+{
+	struct FreeSpace *space = &room->food_space;
+	struct GridRect rect = space_box(space, clip_min, clip_max);
+	if (rect.x1 < 0)
+		return;
+	const double clearance = CONSUMABLE_SAFE_DISTANCE + SPACE_CELL_SIZE * M_SQRT1_2;
+	for (int y = rect.y1; y <= rect.y2; ++y)
+		for (int x = rect.x1; x <= rect.x2; ++x)
 		{
-			if (SKILL_UROBOROS == snake->skill)
+			struct Vec2D bb_min;
+			struct Vec2D bb_max;
+			space_cell_bounds(space, x, y, &bb_min, &bb_max);
+			bool inside;
+			switch (room->cg_mode)
 			{
-				int seg_num = snake->len - i;
-				if (seg_num >= PIECE_DRAW_INCREMENT)
-					sfx_set(ST_BITE);
-				snake_remove_segments(snake, seg_num);
-				return false;
-			}
-			else
-			{
-				return true;
+				case CGM_POLAR:
+				{
+					// the farthest corner decides
+					const double far_x = fmax(fabs(bb_min.x), fabs(bb_max.x));
+					const double far_y = fmax(fabs(bb_min.y), fabs(bb_max.y));
+					inside = far_x * far_x + far_y * far_y < room->cg_polar.radius * room->cg_polar.radius;
+				} break;
+				default:
+					inside = bb_min.x >= room->cg_cartesian.upper_left.x &&
+						bb_min.y >= room->cg_cartesian.upper_left.y &&
+						bb_max.x <= room->cg_cartesian.bottom_right.x &&
+						bb_max.y <= room->cg_cartesian.bottom_right.y;
 			}
+			const struct Vec2D center = {
+				.x = (bb_min.x + bb_max.x) / 2,
+				.y = (bb_min.y + bb_max.y) / 2
+			};
+			space_set_open(space, x, y, inside && sdf_lower_bound(&room->sdf, &center) >= clearance);
 		}
-	}
-	return false;
 }
 
-bool snake_check_wallcollision(const struct Snake *snake, struct Wall walls[], int wallnum)
+// forgets the obstacle, the neighbourhood is computed again
+static void room_sdf_remove(struct Room *room, const struct Segment *seg)
 {
-	if (SKILL_GHOST == snake->skill)
+	const double reach = seg->r + SDF_MAX_DIST;
+	const struct Vec2D clip_min = { .x = seg->pos.x - reach, .y = seg->pos.y - reach };
+	const struct Vec2D clip_max = { .x = seg->pos.x + reach, .y = seg->pos.y + reach };
+	sdf_clear(&room->sdf, &clip_min, &clip_max);
+	room_sdf_stamp(room, &clip_min, &clip_max);
+	flow_block(&room->flow, &room->sdf, &clip_min, &clip_max);
+	room_space_open(room, &clip_min, &clip_max);
+}
+
+bool snake_check_selfcollision(struct Snake *snake, const struct Room *room)
+{
+	// too short to bite itself
+	if (SKILL_GHOST == snake->skill || snake->len - 1 <= START_LEN + 1)
 		return false;
 
-	for (int i = 0; i < wallnum; ++i)
+	// the piece nearest to the tail wins
+	const struct GridCell *cell = grid_cell(&room->grid, &snake->pieces[0]);
+	int i = -1;
+	for (int k = 0; k < cell->num; ++k)
 	{
-		struct Vec2D *vector_distance = wall_dist(&walls[i], &snake->pieces[0]);
-		if (vlen(vector_distance) < (HEAD_RADIUS + walls[i].r))
-		{
-			return true;
-		}
+		const struct GridItem *item = &cell->items[k];
+		if (GI_BODY != item->type || &room->snake[item->owner] != snake ||
+			!snake_chunk_is_near(snake, item->index, &snake->pieces[0], HEAD_RADIUS + BODY_RADIUS))
+			continue;
+		int last;
+		int from = snake_chunk_samples(snake, item->index, START_LEN + 1, &last);
+		if (from <= i)
+			continue;
+		int piece = points_first_hit(&snake->pieces[0], HEAD_RADIUS + BODY_RADIUS,
+			snake->pieces, from, last > i ? last : i, PIECE_DRAW_INCREMENT);
+		if (piece > i)
+			i = piece;
+	}
+	if (i < 0)
+		return false;
+
+	if (SKILL_UROBOROS == snake->skill)
+	{
+		int seg_num = snake->len - i;
+		if (seg_num >= PIECE_DRAW_INCREMENT)
+			sfx_set(ST_BITE);
+		snake_remove_segments(snake, seg_num);
+		return false;
 	}
-	return false;
+	return true;
+}
+
+// can the head hit anything static on its way from the previous step?
+static bool snake_sweep_is_clear(const struct Snake *snake, const struct Room *room)
+{
+	struct Vec2D mid = snake->prev_pieces[0];
+	vlerp(&mid, &snake->pieces[0], 0.5);
+	const double half = 0.5 * vdist(&snake->prev_pieces[0], &snake->pieces[0]);
+	return sdf_lower_bound(&room->sdf, &mid) >= HEAD_RADIUS + half;
 }
 
-bool snake_check_obstaclecollision(struct Snake *snake, struct Obstacle obs[], int obnum)
+static bool snake_sweep_visit(const struct GridItem *item, void *data)
 {
-	if (SKILL_GHOST == snake->skill)
+	struct SweepQuery *query = data;
+	double t = -1;
+	if (GI_WALL == item->type)
+	{
+		t = wall_sweep(&query->room->walls[item->index], query->from, query->to, HEAD_RADIUS);
+	}
+	else
+	{
+		const struct Obstacle *obstacle = &query->room->obstacles[item->index];
+		if (obstacle->valid)
+			t = sweep_circle(query->from, query->to, &obstacle->segment.pos,
+				obstacle->segment.r + HEAD_RADIUS);
+	}
+	// the earliest hit wins, the lower index on a tie
+	if (t >= 0 && (query->index < 0 || t < query->toi ||
+		(t == query->toi && item->index < query->index)))
+	{
+		query->toi = t;
+		query->index = item->index;
+	}
+	return true;
+}
+
+// the head is swept from its previous position, so it cannot pass
+// through anything thinner than its step
+static int snake_sweep(const struct Snake *snake, const struct Room *room,
+	enum GridItemType type, double *toi)
+{
+	struct SweepQuery query = {
+		.room = room,
+		.from = &snake->prev_pieces[0],
+		.to = &snake->pieces[0],
+		.toi = -1,
+		.index = -1
+	};
+	grid_query_ray(&room->grid, query.from, query.to, GRID_MASK(type), snake_sweep_visit, &query);
+	if (query.index >= 0)
+		*toi = query.toi;
+	return query.index;
+}
+
+bool snake_check_wallcollision(const struct Snake *snake, const struct Room *room, double *toi)
+{
+	if (SKILL_GHOST == snake->skill || snake_sweep_is_clear(snake, room))
 		return false;
 
-	for (int i = 0; i < obnum; ++i)
+	return snake_sweep(snake, room, GI_WALL, toi) >= 0;
+}
+
+bool snake_check_obstaclecollision(struct Snake *snake, struct Room *room, double *toi)
+{
+	if (SKILL_GHOST == snake->skill || snake_sweep_is_clear(snake, room))
+		return false;
+
+	int i = snake_sweep(snake, room, GI_OBSTACLE, toi);
+	if (i < 0)
+		return false;
+
+	struct Obstacle *obstacle = &room->obstacles[i];
+	if (SKILL_ONIX == snake->skill)
 	{
-		if (!obs[i].valid)
-			continue;
-		struct Vec2D diff = snake->pieces[0];
-		vsub(&diff, &obs[i].segment.pos);
-		if (vlen(&diff) < (HEAD_RADIUS + obs[i].segment.r))
+		int meal = (obstacle->segment.r / (int)CONSUMABLE_RADIUS) * PIECE_DRAW_INCREMENT;
+		sfx_set(ST_ONIX);
+		snake_add_segments(snake, meal);
+		obstacle->valid = false;
+		grid_update(&room->grid, &obstacle->grid_item, NULL);
+		room_sdf_remove(room, &obstacle->segment);
+		return false;
+	}
+	return true;
+}
+
+static bool safe_position_visit(const struct GridItem *item, void *data)
+{
+	struct SafeQuery *query = data;
+	const struct Room *room = query->room;
+	switch (item->type)
+	{
+		case GI_HEAD:
+			query->hit = room->snake[item->owner].alive &&
+				circle_hit(query->pos, &room->snake[item->owner].pieces[0], query->dist);
+			break;
+		case GI_WALL:
 		{
-			if (SKILL_ONIX == snake->skill)
-			{
-				int meal = (obs[i].segment.r / (int)CONSUMABLE_RADIUS) * PIECE_DRAW_INCREMENT;
-				sfx_set(ST_ONIX);
-				snake_add_segments(snake, meal);
-				obs[i].valid = false;
-				return false;
-			}
-			else
-			{
-				return true;
-			}
-		}
+			const struct Wall *wall = &room->walls[item->index];
+			struct Vec2D wd = wall_dist(wall, query->pos);
+			query->hit = vec_within(&wd, query->dist + wall->r);
+		} break;
+		case GI_OBSTACLE:
+		{
+			const struct Segment *seg = &room->obstacles[item->index].segment;
+			query->hit = circle_hit(query->pos, &seg->pos, query->dist + seg->r);
+		} break;
 	}
-	return false;
+	return !query->hit;
 }
 
 bool generate_safe_position(
-	const struct Room *room, struct Vec2D *pos,
+	const struct Room *room, struct Rng *rng, struct Vec2D *pos,
 	double safe_distance, int max_attempts,
 	bool snake, bool wall, bool obstacle)
 {
@@ -600,28 +1374,54 @@ bool generate_safe_position(
 		{
 			case CGM_CARTESIAN:
 			{
-				pos->x = rand() % (x_to - x_from) + x_from;
-				pos->y = rand() % (y_to - y_from) + y_from;
+				pos->x = rng_int(rng, x_to - x_from) + x_from;
+				pos->y = rng_int(rng, y_to - y_from) + y_from;
 				pos->x = round(pos->x);
 				pos->y = round(pos->y);
 			} break;
 			case CGM_POLAR:
 			{
-				double r = rand() % (int) room->cg_polar.radius;
-				double fi = 2 * M_PI * (rand() % 1024) / 1024;
+				double r = rng_int(rng, (int)room->cg_polar.radius);
+				double fi = 2 * M_PI * rng_int(rng, 1024) / 1024;
 				pos->x = r * cos(fi);
 				pos->y = r * sin(fi);
 				pos->x = round(pos->x);
 				pos->y = round(pos->y);
 			} break;
 		}
+		if (room->grid.cells)
+		{
+			unsigned int mask = 0;
+			if (snake)
+				mask |= GRID_MASK(GI_HEAD);
+			if (wall)
+				mask |= GRID_MASK(GI_WALL);
+			if (obstacle)
+				mask |= GRID_MASK(GI_OBSTACLE);
+			if ((wall || obstacle) && sdf_lower_bound(&room->sdf, pos) >= safe_distance)
+				mask &= ~(GRID_MASK(GI_WALL) | GRID_MASK(GI_OBSTACLE));
+			struct SafeQuery query = {
+				.room = room,
+				.pos = pos,
+				.dist = safe_distance,
+				.hit = false
+			};
+			grid_query_circle(&room->grid, pos, safe_distance, mask, safe_position_visit, &query);
+			if (query.hit)
+			{
+				safe = false;
+				++attempts;
+			}
+			continue;
+		}
+		// the grid is not built yet while the room is being set up
 		if (snake)
 		{
-			for (int i = 0; i < SNAKE_NUM; ++i)
+			for (int i = 0; i < room->snakes_num; ++i)
 			{
 				if (!room->snake[i].alive)
 					continue;
-				if (vdist(pos, &room->snake[i].pieces[0]) < safe_distance)
+				if (circle_hit(pos, &room->snake[i].pieces[0], safe_distance))
 				{
 					safe = false;
 					++attempts;
@@ -634,7 +1434,10 @@ bool generate_safe_position(
 		{
 			for (int i = 0; i < room->walls_num; ++i)
 			{
-				if ((vlen(wall_dist(&room->walls[i], pos)) - room->walls[i].r) < safe_distance)
+				if (!wall_is_near(&room->walls[i], pos, safe_distance))
+					continue;
+				struct Vec2D wd = wall_dist(&room->walls[i], pos);
+				if (vec_within(&wd, safe_distance + room->walls[i].r))
 				{
 					safe = false;
 					++attempts;
@@ -647,7 +1450,7 @@ bool generate_safe_position(
 		{
 			for (int i = 0; i < room->obstacles_num; ++i)
 			{
-				if ((vdist(pos, &room->obstacles[i].segment.pos) - room->obstacles[i].segment.r) < safe_distance)
+				if (circle_hit(pos, &room->obstacles[i].segment.pos, safe_distance + room->obstacles[i].segment.r))
 				{
 					safe = false;
 					++attempts;
@@ -660,86 +1463,105 @@ bool generate_safe_position(
 	return safe;
 }
 
-void consumable_generate(struct Consumable *col, const struct Room *room)
+void consumable_generate(struct Consumable *col, struct Room *room)
 {
-	const int safe_distance = 15;
-
 	col->segment = (struct Segment)
 		{ .pos = { .x = 0, .y = 0 },
 			.r = CONSUMABLE_RADIUS,
 		};
-	col->type = get_random_food();
+	col->type = get_random_food(&room->food_rng);
 	get_sprite_from_food(col->type, &col->food_surface, &col->src_rect);
 
-	if (!generate_safe_position(room, &col->segment.pos,
-		safe_distance, 100, true, true, true))
+	// every point of the free cells is safe, the search is left
+	// for a room with none
+	if (!space_sample(&room->food_space, &room->food_rng, &col->segment.pos) &&
+		!generate_safe_position(room, &room->food_rng, &col->segment.pos,
+		CONSUMABLE_SAFE_DISTANCE, 100, true, true, true))
 	{
 		// spawn it on top of the snake :)
 		col->segment.pos = room->snake[0].pieces[0];
 	}
-	col->phase = 0;
-	col->timeout = 60;
+	col->born = room->timers.now;
+	timer_set(&room->timers, col->grid_item.index, CONSUMABLE_TIMEOUT * SIM_FREQUENCY);
 }
 
-void consumable_process(struct Consumable *col, double dt, const struct Room *room)
+void consumable_expire(struct Consumable *col, struct Room *room)
 {
-	// for drawing
-	col->phase += 2 * M_PI * 0.75 * dt;
-	SINCOS_FIX_INC(col->phase);
-
-	// disappearing after timeout
-	col->timeout -= dt;
-	if (col->timeout < 0)
+	bool evolve = false;
+	switch (col->type)
 	{
-		bool evolve = false;
-		switch (col->type)
-		{
-			case FRUIT_OREBERRY:
-				evolve = rand() % 2 == 0;
-				col->type = FRUIT_METALBERRY;
-				break;
-			case VEGE_CABBAGE:
-				evolve = rand() % 5 == 0;
-				col->type = VEGE_DEVILS_LETTUCE;
-				break;
-			case VEGE_CAYENNE:
-				evolve = rand() % 5 == 0;
-				col->type = VEGE_GHOST_PEPPER;
-				break;
-			case VEGE_SHROOM1:
-			case VEGE_SHROOM2:
-			case VEGE_SHROOM3:
-				evolve = rand() % 5 == 0;
-				col->type = VEGE_GOLD_MUSHROOM;
-				break;
-			case VEGE_BLACK_BEANS:
-			case VEGE_GREEN_BEANS:
-			case VEGE_RED_BEANS:
-				evolve = rand() % 2 == 0;
-				col->type = VEGE_PIXIE_BEANS;
-				break;
-			default:
-				evolve = false;
-		}
+		case FRUIT_OREBERRY:
+			evolve = rng_int(&room->food_rng, 2) == 0;
+			col->type = FRUIT_METALBERRY;
+			break;
+		case VEGE_CABBAGE:
+			evolve = rng_int(&room->food_rng, 5) == 0;
+			col->type = VEGE_DEVILS_LETTUCE;
+			break;
+		case VEGE_CAYENNE:
+			evolve = rng_int(&room->food_rng, 5) == 0;
+			col->type = VEGE_GHOST_PEPPER;
+			break;
+		case VEGE_SHROOM1:
+		case VEGE_SHROOM2:
+		case VEGE_SHROOM3:
+			evolve = rng_int(&room->food_rng, 5) == 0;
+			col->type = VEGE_GOLD_MUSHROOM;
+			break;
+		case VEGE_BLACK_BEANS:
+		case VEGE_GREEN_BEANS:
+		case VEGE_RED_BEANS:
+			evolve = rng_int(&room->food_rng, 2) == 0;
+			col->type = VEGE_PIXIE_BEANS;
+			break;
+		default:
+			evolve = false;
+	}
 
-		if (evolve)
-		{
-			get_sprite_from_food(col->type, &col->food_surface, &col->src_rect);
-			col->timeout = 60;
-		}
-		else
-		{
-			consumable_generate(col, room);
-		}
+	if (evolve)
+	{
+		get_sprite_from_food(col->type, &col->food_surface, &col->src_rect);
+		timer_set(&room->timers, col->grid_item.index, CONSUMABLE_TIMEOUT * SIM_FREQUENCY);
+	}
+	else
+	{
+		consumable_generate(col, room);
 	}
 }
 
-void consumable_draw(struct Consumable *col)
+static double consumable_nearest_distance(const struct GridItem *item, void *data)
+{
+	const struct NearestQuery *query = data;
+	return vdist2(query->pos, &query->room->consumables[item->index].segment.pos);
+}
+
+int consumable_nearest(const struct Room *room, const struct Vec2D *pos)
+{
+	struct NearestQuery query = {
+		.room = room,
+		.pos = pos
+	};
+	struct GridItem nearest;
+	if (!grid_nearest(&room->grid, pos, GRID_MASK(GI_CONSUMABLE),
+		consumable_nearest_distance, &query, &nearest))
+		return 0;
+	return nearest.index;
+}
+
+void consumable_grid_sync(struct Consumable *col, struct Grid *grid)
+{
+	struct GridRect rect = grid_rect(grid, &col->segment.pos, col->segment.r);
+	grid_update(grid, &col->grid_item, &rect);
+}
+
+// the bobbing follows from the age, nothing is kept for it
+void consumable_draw(struct Consumable *col, unsigned int now, double alpha)
 {
 	double x = col->segment.pos.x;
 	double y = col->segment.pos.y;
 	camera_convert(&x, &y);
-	y += (CONSUMABLE_SIZE / 4) * sin(col->phase);
+	const double age = fmax((double)(now - col->born) - 1 + alpha, 0) * SIM_TIMESTEP;
+	y += (CONSUMABLE_SIZE / 4) * sin(2 * M_PI * 0.75 * age);
 	x -= CONSUMABLE_SIZE / 2;
 	y -= CONSUMABLE_SIZE / 2;
 	SDL_Rect dst = {.x = x, .y = y, .w = CONSUMABLE_SIZE, .h = CONSUMABLE_SIZE};
@@ -749,19 +1571,14 @@ void consumable_draw(struct Consumable *col)
 void camera_prepare(const struct Snake *target, enum CameraMode cm)
 {
 	camera.cm = cm;
-	camera.center = &target->pieces[0];
-	camera.angle = &camera.angle_store;
+	camera.target = target;
 	camera.angle_store = 0;
-	if (CM_TPP == cm)
-	{
-		camera.angle = &target->dir;
-	}
-	else if (CM_TPP_DELAYED == cm)
+	if (CM_TPP_DELAYED == cm)
 	{
 		camera.angle_store = target->dir;
-		camera.angle = &camera.angle_store;
-		camera.target_angle = &target->dir;
 	}
+	camera.prev_angle_store = camera.angle_store;
+	camera_interpolate(1.0);
 }
 
 void camera_convert(double *x, double *y)
@@ -772,17 +1589,17 @@ void camera_convert(double *x, double *y)
 			// nothing to do
 			break;
 		case CM_TRACKING:
-			*x = *x - camera.center->x + SCREEN_WIDTH / 2;
-			*y = *y - camera.center->y + SCREEN_HEIGHT / 2;
+			*x = *x - camera.center.x + SCREEN_WIDTH / 2;
+			*y = *y - camera.center.y + SCREEN_HEIGHT / 2;
 			break;
 		case CM_TPP_DELAYED:
 		case CM_TPP:
-			*x -= camera.center->x;
-			*y -= camera.center->y;
+			*x -= camera.center.x;
+			*y -= camera.center.y;
 			double oldx = *x;
 			double oldy = *y;
-			double sinfi = sin(*camera.angle);
-			double cosfi = cos(*camera.angle);
+			double sinfi = sin(camera.angle);
+			double cosfi = cos(camera.angle);
 			*x = oldx * cosfi + oldy * sinfi;
 			*y = -oldx * sinfi + oldy * cosfi;
 			*x += SCREEN_WIDTH / 2;
@@ -793,9 +1610,10 @@ void camera_convert(double *x, double *y)
 
 void camera_process(double dt)
 {
+	camera.prev_angle_store = camera.angle_store;
 	if (CM_TPP_DELAYED == camera.cm)
 	{
-		double diff = *camera.target_angle - camera.angle_store;
+		double diff = camera.target->dir - camera.angle_store;
 		SINCOS_FIX_INC(diff);
 		SINCOS_FIX_DEC(diff);
 		camera.angle_store += 0.6 * diff * dt;
@@ -804,6 +1622,26 @@ void camera_process(double dt)
 	}
 }
 
+// evaluates the camera placement between two last simulation steps
+void camera_interpolate(double alpha)
+{
+	const struct Snake *target = camera.target;
+	camera.center = target->prev_pieces[0];
+	vlerp(&camera.center, &target->pieces[0], alpha);
+	switch (camera.cm)
+	{
+		case CM_TPP:
+			camera.angle = alerp(target->prev_dir, target->dir, alpha);
+			break;
+		case CM_TPP_DELAYED:
+			camera.angle = alerp(camera.prev_angle_store, camera.angle_store, alpha);
+			break;
+		default:
+			camera.angle = camera.angle_store;
+			break;
+	}
+}
+
 void fps_counter(double dt)
 {
 	static double total = 0;
@@ -863,6 +1701,16 @@ void wall_init(struct Wall *wall, double x1, double y1, double x2, double y2, do
 	wall->end.x = round(x2);
 	wall->end.y = round(y2);
 	wall->r = r;
+
+	wall->dir = wall->end;
+	vsub(&wall->dir, &wall->start);
+	wall->len = vlen(&wall->dir);
+	wall->inv_len = wall->len > 0 ? 1.0 / wall->len : 0;
+	vmul(&wall->dir, wall->inv_len);
+	wall->bb_min.x = fmin(wall->start.x, wall->end.x) - r;
+	wall->bb_min.y = fmin(wall->start.y, wall->end.y) - r;
+	wall->bb_max.x = fmax(wall->start.x, wall->end.x) + r;
+	wall->bb_max.y = fmax(wall->start.y, wall->end.y) + r;
 }
 
 static int get_region(int x, int y, int r)
@@ -955,36 +1803,76 @@ void wall_draw(const struct Wall *wall, Uint32 color)
 	filledCircleColor(screen, x2, y2, wall->r, color);
 }
 
-struct Vec2D* wall_dist(const struct Wall *wall, const struct Vec2D *pos)
+// vector from the nearest point of the wall axis to pos, reentrant
+struct Vec2D wall_dist(const struct Wall *wall, const struct Vec2D *pos)
 {
-	static struct Vec2D dist_vector;
-
-	struct Vec2D wall_vector = wall->end;
-	vsub(&wall_vector, &wall->start);
-	struct Vec2D pos_vector = *pos;
-	vsub(&pos_vector, &wall->start);
-	double walllen = vlen(&wall_vector);
-	double projlen = vdot(&wall_vector, &pos_vector) / walllen;
-	double ratio = projlen / walllen;
+	struct Vec2D dist_vector = *pos;
+	vsub(&dist_vector, &wall->start);
+	double projlen = vdot(&wall->dir, &dist_vector);
 
-	if (ratio < 0.0)		// distance to the wall start
+	if (projlen < 0.0)				// distance to the wall start
 	{
-		dist_vector = pos_vector;
+		// dist_vector is ready
 	}
-	else if (ratio > 1.0)	// distance to the wall end
+	else if (projlen > wall->len)	// distance to the wall end
 	{
 		dist_vector = *pos;
 		vsub(&dist_vector, &wall->end);
 	}
-	else					// perpendicular distance
+	else							// perpendicular distance
 	{
-		dist_vector = pos_vector;
-		struct Vec2D projection = wall_vector;
-		vmul(&projection, ratio);
+		struct Vec2D projection = wall->dir;
+		vmul(&projection, projlen);
 		vsub(&dist_vector, &projection);
 	}
 
-	return &dist_vector;
+	return dist_vector;
+}
+
+// cheap rejection test - can pos be closer than margin to the wall surface?
+bool wall_is_near(const struct Wall *wall, const struct Vec2D *pos, double margin)
+{
+	return pos->x > wall->bb_min.x - margin && pos->x < wall->bb_max.x + margin &&
+		pos->y > wall->bb_min.y - margin && pos->y < wall->bb_max.y + margin;
+}
+
+// first t in [0, 1] at which a circle moving from one point to another
+// touches the wall, 0 if it starts there, -1 if it never does
+double wall_sweep(const struct Wall *wall, const struct Vec2D *from, const struct Vec2D *to, double radius)
+{
+	const double r = wall->r + radius;
+	struct Vec2D wd = wall_dist(wall, from);
+	if (vec_within(&wd, r))
+		return 0;
+
+	// the sides, in the coordinates of the wall
+	struct Vec2D f = *from;
+	vsub(&f, &wall->start);
+	struct Vec2D d = *to;
+	vsub(&d, from);
+	const struct Vec2D normal = { .x = -wall->dir.y, .y = wall->dir.x };
+	const double v = vdot(&f, &normal);
+	const double dv = vdot(&d, &normal);
+	const double u = vdot(&f, &wall->dir);
+	const double du = vdot(&d, &wall->dir);
+	double toi = -1;
+	if (dv != 0)
+	{
+		// only the side being approached can be hit first
+		const double t = ((v > 0 ? r : -r) - v) / dv;
+		const double ut = u + t * du;
+		if (t >= 0 && t <= 1 && ut >= 0 && ut <= wall->len)
+			toi = t;
+	}
+
+	// the rounded ends
+	const double t1 = sweep_circle(from, to, &wall->start, r);
+	const double t2 = sweep_circle(from, to, &wall->end, r);
+	if (t1 >= 0 && (toi < 0 || t1 < toi))
+		toi = t1;
+	if (t2 >= 0 && (toi < 0 || t2 < toi))
+		toi = t2;
+	return toi;
 }
 
 void obstacle_init(struct Obstacle *obstacle, double x, double y, double r)
@@ -1001,8 +1889,9 @@ void obstacle_draw(const struct Obstacle *obstacle, const struct Room *room)
 	double x = obstacle->segment.pos.x;
 	double y = obstacle->segment.pos.y;
 	camera_convert(&x, &y);
-	SDL_Surface *spritesheet = obstacle_get_surface(obstacle->segment.r,
-		room->wall_color, room->obstacle_style);
+	SDL_Surface *spritesheet = obstacle_get_surface(obstacle->segment.r);
+	if (NULL == spritesheet)
+		return;
 	SDL_Rect src, dst;
 	src.x = room->obstacle_frame[(int)obstacle->segment.r] * spritesheet->h;
 	src.y = 0;
@@ -1012,21 +1901,223 @@ void obstacle_draw(const struct Obstacle *obstacle, const struct Room *room)
 	SDL_BlitSurface(spritesheet, &src, screen, &dst);
 }
 
-void room_init(struct Room *room)
+// the area where things happen - the consumables and the walls
+static void room_bounds(const struct Room *room, struct Vec2D *bb_min, struct Vec2D *bb_max)
+{
+	switch (room->cg_mode)
+	{
+		case CGM_CARTESIAN:
+			*bb_min = room->cg_cartesian.upper_left;
+			*bb_max = room->cg_cartesian.bottom_right;
+			break;
+		case CGM_POLAR:
+			bb_min->x = bb_min->y = -room->cg_polar.radius;
+			bb_max->x = bb_max->y = room->cg_polar.radius;
+			break;
+	}
+	for (int i = 0; i < room->walls_num; ++i)
+	{
+		bb_min->x = fmin(bb_min->x, room->walls[i].bb_min.x);
+		bb_min->y = fmin(bb_min->y, room->walls[i].bb_min.y);
+		bb_max->x = fmax(bb_max->x, room->walls[i].bb_max.x);
+		bb_max->y = fmax(bb_max->y, room->walls[i].bb_max.y);
+	}
+}
+
+// the grid covers the whole level, things outside of it are kept
+// in the border cells so they are still found, only slower
+static void room_grid_init(struct Room *room)
+{
+	struct Vec2D bb_min;
+	struct Vec2D bb_max;
+	room_bounds(room, &bb_min, &bb_max);
+	bb_min.x -= GRID_CELL_SIZE;
+	bb_min.y -= GRID_CELL_SIZE;
+	bb_max.x += GRID_CELL_SIZE;
+	bb_max.y += GRID_CELL_SIZE;
+	grid_init(&room->grid, &bb_min, &bb_max);
+
+	// walls never move
+	for (int i = 0; i < room->walls_num; ++i)
+	{
+		struct GridRect rect = grid_box(&room->grid, &room->walls[i].bb_min, &room->walls[i].bb_max);
+		grid_insert(&room->grid, &rect, GI_WALL, -1, i);
+	}
+	for (int i = 0; i < room->obstacles_num; ++i)
+	{
+		struct Obstacle *obstacle = &room->obstacles[i];
+		obstacle->grid_item = (struct GridItem) {
+			.type = GI_OBSTACLE,
+			.owner = -1,
+			.index = i,
+			.rect = { .x1 = -1 }
+		};
+		if (!obstacle->valid)
+			continue;
+		struct GridRect rect = grid_rect(&room->grid, &obstacle->segment.pos, obstacle->segment.r);
+		grid_update(&room->grid, &obstacle->grid_item, &rect);
+	}
+	for (int i = 0; i < room->snakes_num; ++i)
+	{
+		snake_grid_sync(&room->snake[i], &room->grid);
+	}
+}
+
+// the distances are known slightly beyond the walls, outside of
+// that the exact tests are always made
+static void room_sdf_init(struct Room *room)
+{
+	struct Vec2D bb_min;
+	struct Vec2D bb_max;
+	room_bounds(room, &bb_min, &bb_max);
+	bb_min.x -= SDF_MAX_DIST;
+	bb_min.y -= SDF_MAX_DIST;
+	bb_max.x += SDF_MAX_DIST;
+	bb_max.y += SDF_MAX_DIST;
+	sdf_init(&room->sdf, &bb_min, &bb_max);
+	room_sdf_stamp(room, NULL, NULL);
+}
+
+// the area of the food is covered, the distances go first
+static void room_space_init(struct Room *room)
+{
+	struct Vec2D bb_min;
+	struct Vec2D bb_max;
+	switch (room->cg_mode)
+	{
+		case CGM_POLAR:
+			bb_min.x = bb_min.y = -room->cg_polar.radius;
+			bb_max.x = bb_max.y = room->cg_polar.radius;
+			break;
+		default:
+			bb_min = room->cg_cartesian.upper_left;
+			bb_max = room->cg_cartesian.bottom_right;
+	}
+	space_init(&room->food_space, &bb_min, &bb_max);
+	room_space_open(room, &bb_min, &bb_max);
+	for (int i = 0; i < room->snakes_num; ++i)
+	{
+		snake_space_sync(&room->snake[i], &room->food_space);
+	}
+}
+
+// every consumable is a target of the flow field
+static void room_flow_update(struct Room *room)
+{
+	for (int i = 0; i < room->consumables_num; ++i)
+	{
+		flow_set_target(&room->flow, i, &room->consumables[i].segment.pos);
+	}
+	flow_update(&room->flow);
+}
+
+// the walkable cells are read from the distance field, so it goes first
+static void room_flow_init(struct Room *room)
+{
+	struct Vec2D bb_min;
+	struct Vec2D bb_max;
+	room_bounds(room, &bb_min, &bb_max);
+	flow_init(&room->flow, &bb_min, &bb_max, room->consumables_num);
+	flow_block(&room->flow, &room->sdf, NULL, NULL);
+	room_flow_update(room);
+}
+
+// what the AI reads of the room, the walls never change so they are shared
+static void room_snapshot(struct Room *view, const struct Room *room)
+{
+	if (!view->snake)
+	{
+		view->snake = (struct Snake *)calloc(room->snakes_num, sizeof(struct Snake));
+		view->consumables = (struct Consumable *)malloc(room->consumables_num * sizeof(struct Consumable));
+		view->obstacles = (struct Obstacle *)malloc(room->obstacles_num * sizeof(struct Obstacle));
+	}
+	view->parallel = false;
+	view->ai_mode = room->ai_mode;
+	view->async = NULL;
+	view->snakes_num = room->snakes_num;
+	view->consumables_num = room->consumables_num;
+	view->walls = room->walls;
+	view->walls_num = room->walls_num;
+	view->obstacles_num = room->obstacles_num;
+	for (int i = 0; i < room->snakes_num; ++i)
+	{
+		snake_copy(&view->snake[i], &room->snake[i]);
+	}
+	memcpy(view->consumables, room->consumables, room->consumables_num * sizeof(struct Consumable));
+	memcpy(view->obstacles, room->obstacles, room->obstacles_num * sizeof(struct Obstacle));
+	grid_copy(&view->grid, &room->grid);
+	sdf_copy(&view->sdf, &room->sdf);
+	flow_copy(&view->flow, &room->flow);
+}
+
+static void room_view_dispose(struct Room *view)
+{
+	for (int i = 0; i < view->snakes_num; ++i)
+	{
+		snake_dispose(&view->snake[i]);
+	}
+	free(view->snake);
+	free(view->consumables);
+	free(view->obstacles);
+	grid_dispose(&view->grid);
+	sdf_dispose(&view->sdf);
+	flow_dispose(&view->flow);
+}
+
+// every saw sheet the room shows is drawn while the level loads
+static void room_prewarm(const struct Room *room)
+{
+	int *radii = (int *)malloc((room->obstacles_num + 1) * sizeof(int));
+	int radii_num = 0;
+	for (int i = 0; i < room->obstacles_num; ++i)
+	{
+		if (room->obstacles[i].valid)
+			radii[radii_num++] = room->obstacles[i].segment.r;
+	}
+	obstacle_prewarm(radii, radii_num, room->wall_color, room->obstacle_style);
+	free(radii);
+}
+
+void room_init(struct Room *room, unsigned int seed)
 {
 	struct Vec2D pos;
 
+	// the whole game follows from the seed
+	room->seed = seed;
+	rng_seed(&room->level_rng, seed, RS_LEVEL);
+	rng_seed(&room->food_rng, seed, RS_FOOD);
+	rng_seed(&room->ai_rng, seed, RS_AI);
 	room->game_over = false;
+	room->parallel = workers_count() > 0;
+	room->ai_mode = menu_options[MO_AI];
+	room->async = NULL;
 	room->consumables_num = 0;
 	room->consumables = NULL;
 	room->walls_num = 0;
 	room->walls = NULL;
 	room->obstacles_num = 0;
 	room->obstacles = NULL;
-	for (int i = 0; i < SNAKE_NUM; ++i)
+	room->grid.cells = NULL;
+	room->sdf.dist = NULL;
+	room->flow.walkable = NULL;
+	room->food_space = (struct FreeSpace) { .cells = NULL };
+	room->timers = (struct TimerWheel) { .timers = NULL };
+	room->eaten = NULL;
+	room->contacts = NULL;
+	room->contacts_num = 0;
+	room->contacts_capacity = 0;
+	room->snakes_num = SNAKE_NUM;
+	if (LT_ARENA == menu_options[MO_LEVELTYPE] || LT_FEAST == menu_options[MO_LEVELTYPE])
+	{
+		room->snakes_num = ARENA_SNAKE_NUM;
+	}
+	room->snake = (struct Snake *)malloc(room->snakes_num * sizeof(struct Snake));
+	for (int i = 0; i < room->snakes_num; ++i)
 	{
 		snake_init(&room->snake[i]);
 		room->snake[i].alive = false;
+		room->snake[i].grid_head.owner = i;
+		room->snake[i].plan.seed = rng_next(&room->ai_rng) | 1;
 	}
 
 	switch (menu_options[MO_LEVELTYPE])
@@ -1055,7 +2146,7 @@ void room_init(struct Room *room)
 			room->obstacles = (struct Obstacle *)malloc(room->obstacles_num * sizeof(struct Obstacle));
 			for (int i = 0; i < room->obstacles_num; ++i)
 			{
-				bool valid = generate_safe_position(room, &pos,
+				bool valid = generate_safe_position(room, &room->level_rng, &pos,
 					48, 100, true, false, true);
 				if (!valid)
 				{
@@ -1067,16 +2158,16 @@ void room_init(struct Room *room)
 					pos.y = -100;
 				}
 				obstacle_init(&room->obstacles[i], pos.x, pos.y,
-					rand() % (max_obstacle_size - min_obstacle_size) + min_obstacle_size);
+					rng_int(&room->level_rng, max_obstacle_size - min_obstacle_size) + min_obstacle_size);
 				room->obstacles[i].valid = valid;
 			}
 
 			// other snakes
-			if (rand() % 8 == 0)
+			if (rng_int(&room->level_rng, 8) == 0)
 			{
-				for (int i = 1; i < SNAKE_NUM; ++i)
+				for (int i = 1; i < room->snakes_num; ++i)
 				{
-					bool valid = generate_safe_position(room, &pos,
+					bool valid = generate_safe_position(room, &room->level_rng, &pos,
 						36, 100, true, true, true);
 					if (valid)
 					{
@@ -1090,7 +2181,7 @@ void room_init(struct Room *room)
 		} break;
 		case LT_POLYGON:
 		{
-			const int outer_wall_num = rand() % 6 + 3;
+			const int outer_wall_num = rng_int(&room->level_rng, 6) + 3;
 			const int circumradius = SCREEN_HEIGHT;
 			room->consumables_num = 4;
 			room->consumables = (struct Consumable *)malloc(room->consumables_num * sizeof(struct Consumable));
@@ -1135,11 +2226,11 @@ void room_init(struct Room *room)
 			camera_prepare(&room->snake[0], CM_TRACKING);
 
 			// other snakes
-			if (rand() % 8 == 0)
+			if (rng_int(&room->level_rng, 8) == 0)
 			{
-				for (int i = 1; i < SNAKE_NUM; ++i)
+				for (int i = 1; i < room->snakes_num; ++i)
 				{
-					bool valid = generate_safe_position(room, &pos,
+					bool valid = generate_safe_position(room, &room->level_rng, &pos,
 						36, 100, true, true, true);
 					if (valid)
 					{
@@ -1156,7 +2247,7 @@ void room_init(struct Room *room)
 			const int wall_thickness = 10;
 			room->consumables_num = 5;
 			room->consumables = (struct Consumable *)malloc(room->consumables_num * sizeof(struct Consumable));
-			int points_no = rand() % 5 + 5;
+			int points_no = rng_int(&room->level_rng, 5) + 5;
 			room->walls_num = points_no * 3;
 			room->walls = (struct Wall *)malloc(room->walls_num * sizeof(struct Wall));
 			// radius of the circumscribed circle of the star
@@ -1216,11 +2307,11 @@ void room_init(struct Room *room)
 			camera_prepare(&room->snake[0], CM_TPP_DELAYED);
 
 			// other snakes
-			if (rand() % 8 == 0)
+			if (rng_int(&room->level_rng, 8) == 0)
 			{
-				for (int i = 1; i < SNAKE_NUM; ++i)
+				for (int i = 1; i < room->snakes_num; ++i)
 				{
-					bool valid = generate_safe_position(room, &pos,
+					bool valid = generate_safe_position(room, &room->level_rng, &pos,
 						36, 100, true, true, true);
 					if (valid)
 					{
@@ -1232,31 +2323,137 @@ void room_init(struct Room *room)
 				}
 			}
 		} break;
+		case LT_ARENA:
+		case LT_FEAST:
+		{
+			const int width = SCREEN_WIDTH * 4;
+			const int height = SCREEN_HEIGHT * 4;
+			const int min_obstacle_size = 12;
+			const int max_obstacle_size = 24;
+			room->consumables_num = LT_FEAST == menu_options[MO_LEVELTYPE] ? FEAST_CONSUMABLES_NUM : 48;
+			room->consumables = (struct Consumable *)malloc(room->consumables_num * sizeof(struct Consumable));
+			room->cg_mode = CGM_CARTESIAN;
+			room->cg_cartesian.upper_left = (struct Vec2D){ .x = 0, .y = 0};
+			room->cg_cartesian.bottom_right = (struct Vec2D){ .x = width, .y = height};
+
+			room->snake[0].alive = true;
+			room->snake[0].pieces[0] = (struct Vec2D){ .x = width / 2, .y = height / 2 };
+			snake_add_segments(&room->snake[0], START_LEN - 1);
+			camera_prepare(&room->snake[0], CM_TRACKING);
+
+			room->walls_num = 4;
+			room->walls = (struct Wall *)malloc(room->walls_num * sizeof(struct Wall));
+			wall_init(&room->walls[0], 0, 0, width, 0, 10);
+			wall_init(&room->walls[1], 0, height, width, height, 10);
+			wall_init(&room->walls[2], 0, 0, 0, height, 10);
+			wall_init(&room->walls[3], width, 0, width, height, 10);
+			room->obstacles_num = 32;
+			room->obstacles = (struct Obstacle *)malloc(room->obstacles_num * sizeof(struct Obstacle));
+			for (int i = 0; i < room->obstacles_num; ++i)
+			{
+				bool valid = generate_safe_position(room, &room->level_rng, &pos,
+					48, 100, true, false, true);
+				if (!valid)
+				{
+					// out of the game field, see the cage level
+					pos.x = -100;
+					pos.y = -100;
+				}
+				obstacle_init(&room->obstacles[i], pos.x, pos.y,
+					rng_int(&room->level_rng, max_obstacle_size - min_obstacle_size) + min_obstacle_size);
+				room->obstacles[i].valid = valid;
+			}
+
+			// the crowd
+			for (int i = 1; i < room->snakes_num; ++i)
+			{
+				bool valid = generate_safe_position(room, &room->level_rng, &pos,
+					36, 100, true, true, true);
+				if (valid)
+				{
+					room->snake[i].pieces[0] = pos;
+					room->snake[i].dir = 2 * M_PI * rng_int(&room->level_rng, 1024) / 1024 - M_PI;
+					snake_add_segments(&room->snake[i], START_LEN - 1);
+					room->snake[i].alive = true;
+				}
+			}
+		} break;
 	}
 
-	int hue = rand() % HUE_PRECISION;
-	tiles_prepare(rand() % SUIT_COUNT, hue);
+	int hue = rng_int(&room->level_rng, HUE_PRECISION);
+	tiles_prepare(rng_int(&room->level_rng, SUIT_COUNT), hue);
 	food_recolor(hue);
 	food_lock();
 	parts_recolor(hue);
 	room->wall_color = get_wall_color(hue);
-	room->obstacle_style = rand() % OBS_STYLES_COUNT + 1;
+	room->obstacle_style = rng_int(&room->level_rng, OBS_STYLES_COUNT) + 1;
+	room_prewarm(room);
 
 	for (int i = 0; i < OBS_SHEETS_COUNT; ++i)
 	{
 		room->obstacle_frame[i] = 0;
 	}
+	room->obstacle_clock = 0;
+
+	// snakes could have been placed after the init
+	for (int i = 0; i < room->snakes_num; ++i)
+	{
+		snake_update_bounds(&room->snake[i]);
+		snake_save_state(&room->snake[i]);
+	}
+
+	room_grid_init(room);
+	room_sdf_init(room);
+	room_space_init(room);
 
+	room->eaten = (int *)malloc(room->consumables_num * sizeof(int));
+	timer_init(&room->timers, room->consumables_num + room->snakes_num);
 	for (int i = 0; i < room->consumables_num; ++i)
 	{
+		room->consumables[i].grid_item = (struct GridItem) {
+			.type = GI_CONSUMABLE,
+			.owner = -1,
+			.index = i,
+			.rect = { .x1 = -1 }
+		};
 		// needs to be done after wall init
 		// AND after food_recolor - food surfaces are reallocated there
 		consumable_generate(&room->consumables[i], room);
+		consumable_grid_sync(&room->consumables[i], &room->grid);
+	}
+	room_flow_init(room);
+
+	if (AI_THREAD)
+	{
+		// the first step decides on its own snapshot, the next one
+		// on the same while the first step is made
+		room->async = (struct AiAsync *)calloc(1, sizeof(struct AiAsync));
+		room_snapshot(&room->async->views[0], room);
+		room_snapshot(&room->async->views[1], room);
 	}
 }
 
 void room_dispose(struct Room *room)
 {
+	if (room->async)
+	{
+		if (room->async->running)
+			workers_join();
+		room_view_dispose(&room->async->views[0]);
+		room_view_dispose(&room->async->views[1]);
+		free(room->async);
+		room->async = NULL;
+	}
+	if (room->snake)
+	{
+		for (int i = 0; i < room->snakes_num; ++i)
+		{
+			snake_dispose(&room->snake[i]);
+		}
+		free(room->snake);
+		room->snake = NULL;
+		room->snakes_num = 0;
+	}
 	if (room->consumables)
 	{
 		free(room->consumables);
@@ -1275,106 +2472,367 @@ void room_dispose(struct Room *room)
 		room->obstacles = NULL;
 		room->obstacles_num = 0;
 	}
+	grid_dispose(&room->grid);
+	sdf_dispose(&room->sdf);
+	flow_dispose(&room->flow);
+	space_dispose(&room->food_space);
+	timer_dispose(&room->timers);
+	free(room->eaten);
+	room->eaten = NULL;
+	free(room->contacts);
+	room->contacts = NULL;
+	room->contacts_num = 0;
+	room->contacts_capacity = 0;
 }
 
-void room_process(struct Room *room, double dt, bool ai)
+// snakes decided by a single control job, the planners take long enough
+// to be spread over the workers one by one
+static int room_control_batch(const struct Room *room)
 {
-	for (int i = 0; i < OBS_SHEETS_COUNT; ++i)
+	return AM_PLANNER == room->ai_mode ? 1 : AI_DUMB_BATCH;
+}
+
+static int room_control_jobs(const struct Room *room)
+{
+	const int batch = room_control_batch(room);
+	return (room->snakes_num + batch - 1) / batch;
+}
+
+static void room_control_job(int index, void *data)
+{
+	struct StepJob *step = data;
+	struct Room *room = step->room;
+	const int batch = room_control_batch(room);
+	struct Snake *snakes[AI_DUMB_BATCH];
+	int num = 0;
+	for (int i = index * batch; i < (index + 1) * batch && i < room->snakes_num; ++i)
+	{
+		if (room->snake[i].alive && (i > 0 || step->ai))
+			snakes[num++] = &room->snake[i];
+	}
+	if (AM_PLANNER == room->ai_mode)
+	{
+		for (int k = 0; k < num; ++k)
+		{
+			snake_ai_plan_control(snakes[k], room, step->dt, step->plan_budget_us);
+		}
+	}
+	else
+	{
+		snake_ai_dumb_batch(snakes, num, room);
+	}
+}
+
+static void room_move_job(int index, void *data)
+{
+	struct StepJob *step = data;
+	struct Snake *snake = &step->room->snake[index];
+	if (!snake->alive)
+		return;
+	snake_process(snake, step->dt);
+}
+
+// time for every planning snake, the budget is split between them,
+// threads beyond one per planner would have nothing to run
+static double room_plan_budget(const struct Room *room, bool ai, int threads)
+{
+	if (AM_PLANNER != room->ai_mode)
+		return 0;
+	int planners = 0;
+	for (int i = ai ? 0 : 1; i < room->snakes_num; ++i)
+	{
+		planners += room->snake[i].alive;
+	}
+	if (threads > planners)
+		threads = planners;
+	return planners > 0 ? AI_PLAN_BUDGET_US * threads / planners : 0;
+}
+
+// runs by the AI thread, the front view is all it touches
+static void room_ai_job(void *data)
+{
+	struct AiAsync *async = data;
+	const int jobs = room_control_jobs(async->step.room);
+	for (int i = 0; i < jobs; ++i)
+	{
+		room_control_job(i, &async->step);
+	}
+}
+
+// the decisions made on the room as it was a step before are applied,
+// then the latest snapshot is handed over to be decided on next
+static void room_ai_collect(struct Room *room, double dt, bool ai)
+{
+	struct AiAsync *async = room->async;
+	if (async->running)
+	{
+		workers_join();
+		async->running = false;
+	}
+	else
+	{
+		async->step = (struct StepJob) {
+			.room = &async->views[async->front],
+			.dt = dt,
+			.ai = ai,
+			.plan_budget_us = room_plan_budget(room, ai, 1)
+		};
+		room_ai_job(async);
+	}
+
+	const struct Room *front = &async->views[async->front];
+	struct Room *back = &async->views[async->front ^ 1];
+	for (int i = 0; i < room->snakes_num; ++i)
 	{
-		++room->obstacle_frame[i];
-		if (room->obstacle_frame[i] >= obstacle_framelimits[i])
-			room->obstacle_frame[i] = 0;
+		struct Snake *snake = &room->snake[i];
+		const struct Snake *decided = &front->snake[i];
+		// the plans go on from where they were left
+		back->snake[i].plan = decided->plan;
+		if (!snake->alive || (0 == i && !ai))
+			continue;
+		// only the choices are taken, the speeds may have changed since
+		snake->turn = decided->turn;
+		snake->v = snake->base_v;
+		snake->w = snake->base_w;
+		if (decided->v > decided->base_v)
+		{
+			snake->v *= SNAKE_V_MULTIPLIER;
+			snake->w *= SNAKE_W_MULTIPLIER;
+		}
 	}
 
-	if (ai)
-		snake_ai_dumb_control(&room->snake[0], room);
+	async->front ^= 1;
+	async->step = (struct StepJob) {
+		.room = back,
+		.dt = dt,
+		.ai = ai,
+		.plan_budget_us = room_plan_budget(back, ai, 1)
+	};
+	async->running = true;
+	workers_launch(room_ai_job, async);
+}
+
+// the room as the step leaves it is decided on by the next one
+static void room_ai_publish(struct Room *room)
+{
+	room_flow_update(room);
+	room_snapshot(&room->async->views[room->async->front ^ 1], room);
+}
+
+// the jobs must touch only the snakes they were given
+static void room_run_snake_jobs(struct Room *room, int count,
+	void (*job)(int index, void *data), struct StepJob *step)
+{
+	if (room->parallel)
+	{
+		workers_parallel_for(count, job, step);
+	}
 	else
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			job(i, step);
+		}
+	}
+}
+
+// by the snakes, head-to-head first
+static int compare_contacts(const void *a, const void *b)
+{
+	const struct SnakeContact *c1 = a;
+	const struct SnakeContact *c2 = b;
+	if (c1->i != c2->i)
+		return c1->i - c2->i;
+	if (c1->j != c2->j)
+		return c1->j - c2->j;
+	return c2->head - c1->head;
+}
+
+void room_process(struct Room *room, double dt, bool ai)
+{
+	// saw animation keeps its own pace regardless of the simulation rate
+	room->obstacle_clock += dt;
+	while (room->obstacle_clock >= 1.0 / OBS_FRAMERATE)
+	{
+		room->obstacle_clock -= 1.0 / OBS_FRAMERATE;
+		for (int i = 0; i < OBS_SHEETS_COUNT; ++i)
+		{
+			++room->obstacle_frame[i];
+			if (room->obstacle_frame[i] >= obstacle_framelimits[i])
+				room->obstacle_frame[i] = 0;
+		}
+	}
+
+	struct StepJob step = { .room = room, .dt = dt, .ai = ai, .plan_budget_us = 0 };
+
+	// decisions see the room as it was left by the previous step,
+	// the food has moved only if something was eaten or timed out
+	room_flow_update(room);
+	if (!ai)
 		snake_control(&room->snake[0]);
-	for (int i = 1; i < SNAKE_NUM; ++i)
+	if (room->async)
 	{
-		if (!room->snake[i].alive) continue;
-		snake_ai_dumb_control(&room->snake[i], room);
+		// or the one before, when they are made in the background
+		room_ai_collect(room, dt, ai);
+	}
+	else
+	{
+		// the planners run side by side when there are workers
+		step.plan_budget_us = room_plan_budget(room, ai,
+			room->parallel ? workers_count() + 1 : 1);
+		room_run_snake_jobs(room, room_control_jobs(room), room_control_job, &step);
 	}
 
-	for (int i = 0; i < room->consumables_num; ++i)
+	// only what is due is looked at
+	timer_tick(&room->timers);
+	for (int k = 0; k < room->timers.fired_num; ++k)
 	{
-		consumable_process(&room->consumables[i], dt, room);
+		const int i = room->timers.fired[k];
+		if (i < room->consumables_num)
+		{
+			consumable_expire(&room->consumables[i], room);
+			consumable_grid_sync(&room->consumables[i], &room->grid);
+		}
+		else
+		{
+			room->snake[i - room->consumables_num].skill = SKILL_NONE;
+		}
 	}
 
-	for (int i = 0; i < SNAKE_NUM; ++i)
+	// every snake moves on its own...
+	room_run_snake_jobs(room, room->snakes_num, room_move_job, &step);
+	for (int i = 0; i < room->snakes_num; ++i)
 	{
-		if (!room->snake[i].alive) continue;
-		snake_process(&room->snake[i], dt);
-		snake_eat_consumables(&room->snake[i], room);
+		snake_grid_sync(&room->snake[i], &room->grid);
+		snake_space_sync(&room->snake[i], &room->food_space);
 	}
 
-	room->game_over = snake_check_selfcollision(&room->snake[0]) ||
-		snake_check_wallcollision(&room->snake[0], room->walls, room->walls_num) ||
-		snake_check_obstaclecollision(&room->snake[0], room->obstacles, room->obstacles_num) ||
-		(room->snake[0].len < START_LEN);
-	for (int i = 1; i < SNAKE_NUM; ++i)
+	// ...and the interactions are resolved in a fixed order
+	for (int i = 0; i < room->snakes_num; ++i)
 	{
-		if (!room->snake[i].alive) continue;
+		struct Snake *snake = &room->snake[i];
+		if (!snake->alive) continue;
+		snake_eat_consumables(snake, room);
+		snake_grid_sync(snake, &room->grid);
 
-		if (snake_check_selfcollision(&room->snake[i]) ||
-			snake_check_wallcollision(&room->snake[i], room->walls, room->walls_num) ||
-			snake_check_obstaclecollision(&room->snake[i], room->obstacles, room->obstacles_num) ||
-			(room->snake[i].len < START_LEN))
+		double toi = 1;
+		bool dead = snake_check_selfcollision(snake, room) ||
+			snake_check_wallcollision(snake, room, &toi) ||
+			snake_check_obstaclecollision(snake, room, &toi) ||
+			(snake->len < START_LEN);
+		if (dead && toi < 1)
+		{
+			// dies where it touched, not somewhere inside
+			struct Vec2D head = snake->prev_pieces[0];
+			vlerp(&head, &snake->pieces[0], toi);
+			snake->pieces[0] = head;
+		}
+		if (0 == i)
 		{
-			room->snake[i].alive = false;
+			room->game_over = dead;
+		}
+		else if (dead)
+		{
+			snake->alive = false;
 			sfx_set(ST_DIE);
 		}
+		snake_grid_sync(snake, &room->grid);
+		snake_space_sync(snake, &room->food_space);
 	}
 
 	// snake-to-snake collisions
-	// quick'n'dirty implementation - to be fixed some day...
-	for (int i = 0; i < SNAKE_NUM; ++i)
+	// every contact is found around the heads first...
+	room->contacts_num = 0;
+	for (int j = 0; j < room->snakes_num; ++j)
 	{
-		if (!room->snake[i].alive || (SKILL_GHOST == room->snake[i].skill))
+		const struct Snake *snake = &room->snake[j];
+		if (!snake->alive || (SKILL_GHOST == snake->skill))
 			continue;
-		for (int j = 0; j < SNAKE_NUM; ++j)
+		const struct GridCell *cell = grid_cell(&room->grid, &snake->pieces[0]);
+		for (int k = 0; k < cell->num; ++k)
 		{
-			if (!room->snake[j].alive ||
-				(SKILL_GHOST == room->snake[j].skill) ||
-				(i == j))
+			const struct GridItem *item = &cell->items[k];
+			if ((GI_HEAD != item->type && GI_BODY != item->type) || item->owner == j)
 				continue;
-
-			// head-to-head
-			struct Vec2D diff = room->snake[i].pieces[0];
-			vsub(&diff, &room->snake[j].pieces[0]);
-			if (vlen(&diff) < (HEAD_RADIUS + HEAD_RADIUS))
+			const struct Snake *other = &room->snake[item->owner];
+			if (!other->alive || (SKILL_GHOST == other->skill))
+				continue;
+			bool hit;
+			if (GI_HEAD == item->type)
 			{
-				room->snake[i].alive = false;
-				room->snake[j].alive = false;
-				if (0 == j || 0 == i)
-				{
-					room->game_over = true;
-				}
-				sfx_set(ST_DIE);
-				break;
+				hit = circle_hit(&other->pieces[0], &snake->pieces[0], HEAD_RADIUS + HEAD_RADIUS);
+			}
+			else
+			{
+				// only the chunks around the head are descended into
+				int last;
+				int from = snake_chunk_samples(other, item->index, 0, &last);
+				hit = snake_chunk_is_near(other, item->index, &snake->pieces[0], HEAD_RADIUS + BODY_RADIUS) &&
+					points_first_hit(&snake->pieces[0], HEAD_RADIUS + BODY_RADIUS,
+						other->pieces, from, last, PIECE_DRAW_INCREMENT) >= 0;
+			}
+			if (!hit)
+				continue;
+			if (room->contacts_num == room->contacts_capacity)
+			{
+				room->contacts_capacity = room->contacts_capacity ? room->contacts_capacity * 2 : 16;
+				room->contacts = (struct SnakeContact *)realloc(room->contacts,
+					room->contacts_capacity * sizeof(struct SnakeContact));
 			}
+			room->contacts[room->contacts_num++] = (struct SnakeContact) {
+				.i = item->owner,
+				.j = j,
+				.head = GI_HEAD == item->type
+			};
+		}
+	}
 
-			for (int k = room->snake[i].len - 1; k > 0; k -= PIECE_DRAW_INCREMENT)
+	// ...then they are resolved in the order of the snakes
+	if (room->contacts_num > 1)
+		qsort(room->contacts, room->contacts_num, sizeof(struct SnakeContact), compare_contacts);
+	for (int k = 0; k < room->contacts_num; ++k)
+	{
+		const struct SnakeContact *contact = &room->contacts[k];
+		struct Snake *snake_i = &room->snake[contact->i];
+		struct Snake *snake_j = &room->snake[contact->j];
+		if (!snake_i->alive || !snake_j->alive)
+			continue;
+		if (contact->head)
+		{
+			snake_i->alive = false;
+			snake_j->alive = false;
+			if (0 == contact->j || 0 == contact->i)
 			{
-				struct Vec2D diff = room->snake[j].pieces[0];
-				vsub(&diff, &room->snake[i].pieces[k]);
-				if (vlen(&diff) < (HEAD_RADIUS + BODY_RADIUS))
-				{
-					room->snake[j].alive = false;
-					if (0 == j)
-					{
-						room->game_over = true;
-					}
-					sfx_set(ST_DIE);
-					break;
-				}
+				room->game_over = true;
+			}
+		}
+		else
+		{
+			snake_j->alive = false;
+			if (0 == contact->j)
+			{
+				room->game_over = true;
 			}
 		}
+		sfx_set(ST_DIE);
+	}
+	for (int i = 0; i < room->snakes_num; ++i)
+	{
+		if (!room->snake[i].alive)
+		{
+			snake_grid_sync(&room->snake[i], &room->grid);
+			snake_space_sync(&room->snake[i], &room->food_space);
+		}
 	}
+
+	if (room->async)
+		room_ai_publish(room);
 }
 
-void room_draw(const struct Room *room)
+void room_draw(const struct Room *room, double alpha)
 {
+	camera_interpolate(alpha);
+
 	// draw background
 #ifdef CHECKERBOARD_OFF
 	SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 128, 128, 128));
@@ -1385,9 +2843,9 @@ void room_draw(const struct Room *room)
 	{
 		case CM_TRACKING:
 		{
-			ox = (int)(camera.center->x - SCREEN_WIDTH / 2) % (CHECKERBOARD_SIZE * 2);
+			ox = (int)(camera.center.x - SCREEN_WIDTH / 2) % (CHECKERBOARD_SIZE * 2);
 			if (ox < 0) ox = (CHECKERBOARD_SIZE * 2) + ox;
-			oy = (int)(camera.center->y - SCREEN_HEIGHT / 2) % (CHECKERBOARD_SIZE * 2);
+			oy = (int)(camera.center.y - SCREEN_HEIGHT / 2) % (CHECKERBOARD_SIZE * 2);
 			if (oy < 0) oy = (CHECKERBOARD_SIZE * 2) + oy;
 		} // fallthrough
 		case CM_FIXED:
@@ -1420,8 +2878,8 @@ void room_draw(const struct Room *room)
 		{
 			SDL_LockSurface(screen);
 			const int bpp = screen->format->BytesPerPixel;
-			const double sinfi = sin(*camera.angle);
-			const double cosfi = cos(*camera.angle);
+			const double sinfi = sin(camera.angle);
+			const double cosfi = cos(camera.angle);
 			const int delta_x = cosfi * 65536;
 			const int delta_y = sinfi * 65536;
 			const double bx = -SCREEN_WIDTH / 2;
@@ -1429,8 +2887,8 @@ void room_draw(const struct Room *room)
 			const double ax = bx * cosfi - by * sinfi;
 			const double ay = bx * sinfi + by * cosfi;
 			// fixed-point representation
-			int xx = (ax + camera.center->x) * 65536;
-			int yy = (ay + camera.center->y) * 65536;
+			int xx = (ax + camera.center.x) * 65536;
+			int yy = (ay + camera.center.y) * 65536;
 			for (int y = 0; y < SCREEN_HEIGHT; ++y)
 			{
 				int fx = xx;
@@ -1463,7 +2921,7 @@ void room_draw(const struct Room *room)
 #endif
 	for (int i = 0; i < room->consumables_num; ++i)
 	{
-		consumable_draw(&room->consumables[i]);
+		consumable_draw(&room->consumables[i], room->timers.now, alpha);
 	}
 	for (int i = 0; i < room->walls_num; ++i)
 	{
@@ -1473,10 +2931,10 @@ void room_draw(const struct Room *room)
 	{
 		obstacle_draw(&room->obstacles[i], room);
 	}
-	for (int i = 0; i < SNAKE_NUM; ++i)
+	for (int i = 0; i < room->snakes_num; ++i)
 	{
 		if (!room->snake[i].alive) continue;
-		snake_draw(&room->snake[i]);
+		snake_draw(&room->snake[i], alpha);
 	}
 }
 
@@ -1500,49 +2958,3 @@ void sfx_play(void)
 	Mix_PlayChannel(-1, sfx_chunks[sfx_st], 0);
 	sfx_st = ST_END;
 }
-
-enum Food get_random_food(void)
-{
-	int prob = rand() % food_probability_sum;
-	int idx = 0;
-	for (int i = 0; i < FOOD_END; ++i)
-	{
-		if (i == FRUIT_END)
-			i = VEGE_START;
-		if (prob < food_probability_table[i])
-		{
-			idx = i;
-			break;
-		}
-		else
-		{
-			prob -= food_probability_table[i];
-		}
-	}
-	return (enum Food)idx;
-}
-
-void food_lock(void)
-{
-	food_probability_table[FRUIT_CINDERBERRY] = 0;
-	food_probability_table[FRUIT_OREBERRY] = 0;
-	food_probability_table[FRUIT_SOULFRUIT] = 0;
-	food_evaluate_probability();
-}
-
-void food_unlock(void)
-{
-	food_probability_table[FRUIT_CINDERBERRY] = 5;
-	food_probability_table[FRUIT_OREBERRY] = 5;
-	food_probability_table[FRUIT_SOULFRUIT] = 3;
-	food_evaluate_probability();
-}
-
-void food_evaluate_probability(void)
-{
-	food_probability_sum = 0;
-	for (int i = 0; i < FOOD_END; ++i)
-	{
-		food_probability_sum += food_probability_table[i];
-	}
-}
@@ -4,6 +4,12 @@
 #include <stdbool.h>
 #include <SDL.h>
 #include "gfx.h"
+#include "grid.h"
+#include "sdf.h"
+#include "flow.h"
+#include "space.h"
+#include "rng.h"
+#include "timer.h"
 
 #define MAX_SNAKE_LEN					(10240)
 #define START_LEN						(60)
@@ -12,6 +18,10 @@
 #define PIECE_DISTANCE					(0.5)
 #define PIECE_DRAW_INCREMENT			(12)
 #define CONSUMABLE_RADIUS				(6.0)
+// food appears no nearer than this to the heads and the geometry
+#define CONSUMABLE_SAFE_DISTANCE		(15.0)
+// seconds until uneaten food evolves or moves elsewhere
+#define CONSUMABLE_TIMEOUT				(60)
 #define EAT_DEPTH						(2.0)
 #define SNAKE_V_MULTIPLIER				(2.0)
 #define SNAKE_W_MULTIPLIER				(1.5)
@@ -24,10 +34,56 @@
 #define SNAKE_BASE_V_MULTIPLIER			(1.19)
 #define SNAKE_BASE_W_MULTIPLIER			(1.10)
 #define SNAKE_NUM						(2)
+#define SNAKE_INITIAL_CAPACITY			(128)
+// the body is split into chunks of consecutive pieces, from the head
+#define BODY_CHUNK_SHIFT				(6)
+#define BODY_CHUNK_SIZE					(1 << BODY_CHUNK_SHIFT)
+#define BODY_CHUNKS(len)				(((len) + BODY_CHUNK_SIZE - 1) >> BODY_CHUNK_SHIFT)
+// the feast is the arena with the table laid for everyone
+#if defined(MIYOO)
+#define ARENA_SNAKE_NUM					(24)
+#define FEAST_CONSUMABLES_NUM			(96)
+#else
+#define ARENA_SNAKE_NUM					(128)
+#define FEAST_CONSUMABLES_NUM			(384)
+#endif
+
+// the simulation runs at a fixed rate, independent of the rendering,
+// the head is swept so the walls hold even with the coarser step
+#if defined(MIYOO)
+#define SIM_FREQUENCY					(60)
+#else
+#define SIM_FREQUENCY					(120)
+#endif
+#define SIM_TIMESTEP					(1.0 / SIM_FREQUENCY)
+// maximum number of simulation steps caught up within one frame
+#define SIM_MAX_STEPS					(8)
+
+#define SENSOR_MAX_POINTS				(32)
 
 #define AI_DUMB_EYES_NUM				(16)
 #define AI_DUMB_VISION_RANGE			(24.0)
 #define AI_DUMB_DETECTION_MARGIN		(3.0)
+// snakes decided together by snake_ai_dumb_batch
+#define AI_DUMB_BATCH					(16)
+
+// the planner looks this many moves ahead, a move lasts the segment time
+// and is simulated in steps of AI_PLAN_DT
+#define AI_PLAN_SEGMENTS				(6)
+#define AI_PLAN_SEGMENT_TIME			(0.125)
+#define AI_PLAN_DT						(1.0 / 32)
+// nearest heads of the other snakes the planner keeps away from
+#define AI_PLAN_MAX_HEADS				(8)
+// time shared by all the planning snakes in every simulation step and
+// the candidates tried no matter the budget: steering straight, left and
+// right, then the same while speeding
+#if defined(MIYOO)
+#define AI_PLAN_BUDGET_US				(1000.0)
+#define AI_PLAN_MIN_TRIES				(3)
+#else
+#define AI_PLAN_BUDGET_US				(4000.0)
+#define AI_PLAN_MIN_TRIES				(6)
+#endif
 
 #define SDL_CHECK(x) if (x) { printf("SDL: %s\n", SDL_GetError()); exit(0); }
 #define SDLGFX_COLOR(r, g, b) (((r) << 24) | ((g) << 16) | ((b) << 8) | 0xff)
@@ -69,6 +125,30 @@ enum ConsumableGenerationMode
 	CGM_POLAR
 };
 
+// independent streams of the random numbers of a room, so the food
+// does not change when the level is built differently and so on
+enum RngStream
+{
+	RS_LEVEL,
+	RS_FOOD,
+	RS_AI
+};
+
+// moves of the planner AI, the first one is under way
+struct AiPlan
+{
+	enum Turn turn[AI_PLAN_SEGMENTS];
+	bool accelerate[AI_PLAN_SEGMENTS];
+	double left;	// time left of the first move
+	unsigned int seed;	// of the candidates, never 0
+};
+
+struct BodyChunk
+{
+	struct Vec2D bb_min;
+	struct Vec2D bb_max;
+};
+
 struct Snake
 {
 	double v;	// linear speed
@@ -76,30 +156,48 @@ struct Snake
 	double w;	// angular speed
 	double base_w;
 	double dir;	// angular position
+	double prev_dir;
 	double wobbly_freq;
 	double wobbly_phase;	// wobbly phase
 	int len;
-	struct Vec2D pieces[MAX_SNAKE_LEN];
+	int capacity;	// number of allocated pieces
+	struct Vec2D *pieces;
+	// bounding box of all the pieces and of every chunk of them,
+	// a chunk past the tail may be larger than its pieces
+	struct Vec2D bb_min;
+	struct Vec2D bb_max;
+	struct BodyChunk *chunks;
+	// state of the previous simulation step, used for interpolation
+	int prev_len;
+	struct Vec2D *prev_pieces;
+	// registration in the room grid, the head and every chunk
+	struct GridItem grid_head;
+	struct GridItem *grid_chunks;
+	int grid_chunks_num;	// initialized items, not all of them registered
+	int grid_chunks_capacity;
+	// cells of the free space around the head where no food can appear
+	struct GridRect space_rect;
 	enum Turn turn;
-	enum SkillType skill;
-	double skill_timeout;
+	struct AiPlan plan;
+	enum SkillType skill;	// a timer of the room takes it away, if set
 	bool alive;
 };
 
 struct Consumable
 {
 	struct Segment segment;
-	double phase;
-	double timeout;
+	unsigned int born;	// step of the room it appeared in, for the bobbing
 	enum Food type;
 	SDL_Surface *food_surface;
 	SDL_Rect src_rect;
+	struct GridItem grid_item;
 };
 
 struct Obstacle
 {
 	struct Segment segment;
 	bool valid;
+	struct GridItem grid_item;
 };
 
 struct Wall
@@ -107,21 +205,59 @@ struct Wall
 	struct Vec2D start;
 	struct Vec2D end;
 	double r;
+	// precomputed in wall_init
+	struct Vec2D dir;	// unit vector from start to end
+	double len;
+	double inv_len;
+	struct Vec2D bb_min;	// bounding box, thickness included
+	struct Vec2D bb_max;
+};
+
+// occupancy of sampled points as seen by a snake, see snake_sense
+struct Sensor
+{
+	int num;
+	struct Vec2D points[SENSOR_MAX_POINTS];
+	int hits[SENSOR_MAX_POINTS];	// number of things covering each point
+	unsigned int mask;	// GRID_MASK of the kinds of things sensed
+	double body_margin;	// bodies are sensed wider by up to GRID_MARGIN
+};
+
+// snake j has run into snake i
+struct SnakeContact
+{
+	int i;
+	int j;
+	bool head;	// head-to-head, otherwise head of j to body of i
 };
 
 struct Camera
 {
 	enum CameraMode cm;
-	const struct Vec2D *center;
-	const double *angle;
+	const struct Snake *target;
 	double angle_store;
-	const double *target_angle;
+	double prev_angle_store;
+	// interpolated values used for drawing
+	struct Vec2D center;
+	double angle;
 };
 
+struct AiAsync;
+
 struct Room
 {
 	bool game_over;
-	struct Snake snake[SNAKE_NUM];
+	bool parallel;	// snakes are stepped by the worker pool
+	enum AiMode ai_mode;
+	// the AI decides on snapshots by a thread of its own, NULL when
+	// it is run within the step
+	struct AiAsync *async;
+	unsigned int seed;	// of the generators, see room_init
+	struct Rng level_rng;	// building of the level
+	struct Rng food_rng;	// food and what it does
+	struct Rng ai_rng;	// seeds of the planners
+	struct Snake *snake;
+	int snakes_num;
 	enum ConsumableGenerationMode cg_mode;
 	union
 	{
@@ -145,6 +281,23 @@ struct Room
 	Uint32 wall_color;
 	int obstacle_style;
 	int obstacle_frame[OBS_SHEETS_COUNT];
+	double obstacle_clock;
+	// spatial index of everything but the camera, see room_grid_init
+	struct Grid grid;
+	// distance to the walls and the obstacles still standing
+	struct DistanceField sdf;
+	// ways around the walls to the nearest food, shared by the AI
+	struct FlowField flow;
+	// where new food can appear, see consumable_generate
+	struct FreeSpace food_space;
+	// timeouts of the consumables and then the skills of the snakes,
+	// the steps made are counted by it
+	struct TimerWheel timers;
+	// scratch buffers of room_process
+	int *eaten;
+	struct SnakeContact *contacts;
+	int contacts_num;
+	int contacts_capacity;
 };
 
 void fps_counter(double dt);
@@ -160,52 +313,69 @@ struct Vec2D* vmul(struct Vec2D *dst, double scalar);
 double vdot(const struct Vec2D *vec1, const struct Vec2D *vec2);
 double vlen(const struct Vec2D *vec);
 double vdist(const struct Vec2D *vec1, const struct Vec2D *vec2);
+double vdist2(const struct Vec2D *vec1, const struct Vec2D *vec2);
+struct Vec2D* vlerp(struct Vec2D *dst, const struct Vec2D *elem, double t);
+double alerp(double from, double to, double t);
 
 bool generate_safe_position(
-	const struct Room *room, struct Vec2D *pos,
+	const struct Room *room, struct Rng *rng, struct Vec2D *pos,
 	double safe_distance, int max_attempts,
 	bool snake, bool wall, bool obstacle);
 
 void camera_prepare(const struct Snake *target, enum CameraMode cm);
 void camera_convert(double *x, double *y);
 void camera_process(double dt);
+void camera_interpolate(double alpha);
 
 void snake_init(struct Snake *snake);
+void snake_dispose(struct Snake *snake);
+void snake_update_bounds(struct Snake *snake);
+bool snake_is_near(const struct Snake *snake, const struct Vec2D *pos, double margin);
+void snake_save_state(struct Snake *snake);
 void snake_process(struct Snake *snake, double dt);
-void snake_draw(const struct Snake *snake);
+void snake_draw(const struct Snake *snake, double alpha);
 void snake_control(struct Snake *snake);
+void snake_sense(const struct Snake *snake, const struct Room *room, struct Sensor *sensor);
 void snake_ai_dumb_control(struct Snake *snake, const struct Room *room);
+void snake_ai_dumb_batch(struct Snake *const snakes[], int num, const struct Room *room);
+void snake_ai_plan_control(struct Snake *snake, const struct Room *room, double dt, double budget_us);
 void snake_add_segments(struct Snake *snake, int count);
 void snake_remove_segments(struct Snake *snake, int count);
 void snake_eat_consumables(struct Snake *snake, struct Room *room);
-static void snake_apply_effects(struct Snake *snake, enum Food food);
-bool snake_check_selfcollision(struct Snake *snake);
-bool snake_check_wallcollision(const struct Snake *snake, struct Wall walls[], int wallnum);
-bool snake_check_obstaclecollision(struct Snake *snake, struct Obstacle obs[], int obnum);
+static void snake_apply_effects(struct Snake *snake, enum Food food, struct Room *room);
+bool snake_check_selfcollision(struct Snake *snake, const struct Room *room);
+bool snake_check_wallcollision(const struct Snake *snake, const struct Room *room, double *toi);
+bool snake_check_obstaclecollision(struct Snake *snake, struct Room *room, double *toi);
+void snake_grid_sync(struct Snake *snake, struct Grid *grid);
+void snake_space_sync(struct Snake *snake, struct FreeSpace *space);
 
-void consumable_generate(struct Consumable *col, const struct Room *room);
-void consumable_process(struct Consumable *col, double dt, const struct Room *room);
-void consumable_draw(struct Consumable *col);
+void consumable_generate(struct Consumable *col, struct Room *room);
+// the food has not been eaten in time
+void consumable_expire(struct Consumable *col, struct Room *room);
+void consumable_draw(struct Consumable *col, unsigned int now, double alpha);
+void consumable_grid_sync(struct Consumable *col, struct Grid *grid);
+// the one nearest to pos, the lowest index of the nearest ones
+int consumable_nearest(const struct Room *room, const struct Vec2D *pos);
 
 void wall_init(struct Wall *wall, double x1, double y1, double x2, double y2, double r);
 void wall_draw(const struct Wall *wall, Uint32 color);
-struct Vec2D* wall_dist(const struct Wall *wall, const struct Vec2D *pos);
+struct Vec2D wall_dist(const struct Wall *wall, const struct Vec2D *pos);
+bool wall_is_near(const struct Wall *wall, const struct Vec2D *pos, double margin);
+double wall_sweep(const struct Wall *wall, const struct Vec2D *from, const struct Vec2D *to, double radius);
 
 void obstacle_init(struct Obstacle *obstacle, double x, double y, double r);
 void obstacle_draw(const struct Obstacle *obstacle, const struct Room *room);
 
-void room_init(struct Room *room);
+// the same seed gives the same game for the same moves of the player,
+// the saws are drawn on the background thread the planner uses too, so
+// obstacle_prewarm_finish must be called before the first room_process
+void room_init(struct Room *room, unsigned int seed);
 void room_dispose(struct Room *room);
 void room_process(struct Room *room, double dt, bool ai);
-void room_draw(const struct Room *room);
+void room_draw(const struct Room *room, double alpha);
 bool room_check_gameover(struct Room *room);
 
 void sfx_set(enum SoundType st);
 void sfx_play(void);
 
-enum Food get_random_food(void);
-void food_lock(void);
-void food_unlock(void);
-void food_evaluate_probability(void);
-
 #endif
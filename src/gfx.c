@@ -1,8 +1,11 @@
 #include "gfx.h"
 #include "main.h"
 #include "svg_support.h"
+#include "workers.h"
+#include "sheetfile.h"
 #include <SDL_image.h>
 #include <SDL_gfxPrimitives.h>
+#include <SDL_thread.h>
 #include <math.h>
 #include <stdbool.h>
 
@@ -21,14 +24,89 @@ SDL_Surface *snake_body[SKILL_END] = { NULL };
 int obstacle_framelimits[OBS_SHEETS_COUNT];
 
 static SDL_Surface *tiles_orig = NULL;
+// the sheets of the current room by radius, they are owned by the cache
 static SDL_Surface *obstacle_surfaces[OBS_SHEETS_COUNT];
+// every style is parsed once, the sheets of all the sizes are drawn from it
+static struct NSVGimage *obstacle_templates[OBS_STYLES_COUNT];
+// the sheet files drawn from an older file are not taken
+static uint64_t obstacle_template_hashes[OBS_STYLES_COUNT];
 static const int obstacle_gears_num[OBS_STYLES_COUNT] = {
 	4, 40, 12, 9, 24, 8
 };
+// one per thread taking part in the prerender
+static struct NSVGrasterizer *obstacle_rasterizers[WORKERS_MAX + 1];
+
+// a sheet kept for the rooms to come, the same look is drawn only once
+struct ObstacleSheet
+{
+	int style;
+	int radius;
+	Uint32 color;
+	SDL_Surface *surface;
+	int frames;
+	size_t bytes;
+	unsigned int used;	// stamp of the last prewarm that wanted it
+};
+
+static struct ObstacleSheet *sheets = NULL;
+static int sheets_num = 0;
+static int sheets_capacity = 0;
+static unsigned int sheets_clock = 0;
+static struct ObstacleCacheStats sheets_stats = { .budget = SHEET_CACHE_BUDGET };
+
+// a frame to be drawn into its slot of a sheet
+struct ObstacleFrame
+{
+	int radius;
+	int index;
+	float angle;
+};
+
+struct ObstaclePrerender
+{
+	struct NSVGimage *image;
+	struct ObstacleFrame *frames;
+	int frames_num;
+	int *fresh;		// radii of the sheets being drawn
+	int fresh_num;
+	int style;
+	Uint32 color;
+	int lanes;
+	int cr, cg, cb, ca;
+	bool failed[WORKERS_MAX + 1];
+	SDL_mutex *lock;
+	int done;		// frames finished so far, guarded by the lock
+};
+
+// the prewarm under way, if pending the launched job is filling the sheets
+static struct ObstaclePrerender prewarm;
+static bool prewarm_pending = false;
+
+// the new sheets are written out while the game goes on, they stay bound
+// to the room until the next prewarm, which waits for the writer first
+struct ObstacleSave
+{
+	struct SheetKey keys[OBS_SHEETS_COUNT];
+	SDL_Surface *surfaces[OBS_SHEETS_COUNT];
+	int frames[OBS_SHEETS_COUNT];
+	int num;
+};
+
+static struct ObstacleSave saving;
+static SDL_Thread *saver = NULL;
 
 static void rgb_to_hsv(double *rh, double *gs, double *bv);
 static void hsv_to_rgb(double *hr, double *sg, double *vb);
 static void surface_recolor(SDL_Surface *s, int hue);
+static void obstacle_prerender_job(int lane, void *data);
+static void obstacle_prewarm_job(void *data);
+static void obstacle_prewarm_cleanup(void);
+static int obstacle_save_main(void *data);
+static void obstacle_save_join(void);
+static struct ObstacleSheet *obstacle_sheet_find(int style, int radius, Uint32 color);
+static bool obstacle_sheet_bound(const struct ObstacleSheet *sheet);
+static void obstacle_sheets_evict(size_t budget);
+static void obstacle_sheet_add(int style, int radius, Uint32 color, int frames);
 
 // r,g,b - range 0..1
 static void rgb_to_hsv(double *rh, double *gs, double *bv)
@@ -531,68 +609,398 @@ void parts_dispose(void)
 
 void obstacle_free_surfaces(void)
 {
+	obstacle_prewarm_finish();
+	obstacle_save_join();
 	for (int i = 0; i < OBS_SHEETS_COUNT; ++i)
 	{
-		if (obstacle_surfaces[i])
+		obstacle_surfaces[i] = NULL;
+	}
+	for (int i = 0; i < sheets_num; ++i)
+	{
+		SDL_FreeSurface(sheets[i].surface);
+	}
+	free(sheets);
+	sheets = NULL;
+	sheets_num = sheets_capacity = 0;
+	sheets_stats.bytes = 0;
+	sheets_stats.sheets = 0;
+}
+
+static struct ObstacleSheet *obstacle_sheet_find(int style, int radius, Uint32 color)
+{
+	for (int i = 0; i < sheets_num; ++i)
+	{
+		if (sheets[i].radius == radius && sheets[i].style == style && sheets[i].color == color)
+			return &sheets[i];
+	}
+	return NULL;
+}
+
+// the sheets of the current room are never evicted
+static bool obstacle_sheet_bound(const struct ObstacleSheet *sheet)
+{
+	return obstacle_surfaces[sheet->radius] == sheet->surface;
+}
+
+// the least recently used sheets go first until the rest fits the budget
+static void obstacle_sheets_evict(size_t budget)
+{
+	while (sheets_stats.bytes > budget)
+	{
+		int victim = -1;
+		for (int i = 0; i < sheets_num; ++i)
+		{
+			if (!obstacle_sheet_bound(&sheets[i]) && (victim < 0 || sheets[i].used < sheets[victim].used))
+				victim = i;
+		}
+		if (victim < 0)
+			break;
+		SDL_FreeSurface(sheets[victim].surface);
+		sheets_stats.bytes -= sheets[victim].bytes;
+		--sheets_stats.sheets;
+		++sheets_stats.evictions;
+		sheets[victim] = sheets[--sheets_num];
+	}
+}
+
+// the sheet is bound already
+static void obstacle_sheet_add(int style, int radius, Uint32 color, int frames)
+{
+	struct ObstacleSheet *sheet = &sheets[sheets_num++];
+	*sheet = (struct ObstacleSheet) {
+		.style = style,
+		.radius = radius,
+		.color = color,
+		.surface = obstacle_surfaces[radius],
+		.frames = frames,
+		.bytes = (size_t)obstacle_surfaces[radius]->pitch * obstacle_surfaces[radius]->h,
+		.used = sheets_clock
+	};
+	obstacle_framelimits[radius] = frames;
+	sheets_stats.bytes += sheet->bytes;
+	++sheets_stats.sheets;
+}
+
+void obstacle_cache_budget(size_t bytes)
+{
+	sheets_stats.budget = bytes;
+	obstacle_prewarm_finish();
+	obstacle_sheets_evict(bytes);
+}
+
+void obstacle_cache_stats(struct ObstacleCacheStats *stats)
+{
+	*stats = sheets_stats;
+}
+
+void obstacle_dispose(void)
+{
+	obstacle_free_surfaces();
+	for (int i = 0; i < OBS_STYLES_COUNT; ++i)
+	{
+		SVG_Free(obstacle_templates[i]);
+		obstacle_templates[i] = NULL;
+	}
+	for (int i = 0; i < WORKERS_MAX + 1; ++i)
+	{
+		SVG_DeleteRasterizer(obstacle_rasterizers[i]);
+		obstacle_rasterizers[i] = NULL;
+	}
+	SVG_Quit();
+}
+
+// every lane takes every lanes-th frame, so the sizes are spread evenly
+static void obstacle_prerender_job(int lane, void *data)
+{
+	struct ObstaclePrerender *work = data;
+	for (int i = lane; i < work->frames_num; i += work->lanes)
+	{
+		const struct ObstacleFrame *frame = &work->frames[i];
+		const int ssize = frame->radius * 2 + 4;
+		SDL_Rect dst = { frame->index * ssize, 0, ssize, ssize };
+		if (SVG_RasterizeWith(obstacle_rasterizers[lane], work->image,
+			obstacle_surfaces[frame->radius], &dst,
+			work->cr, work->cg, work->cb, work->ca, frame->angle) < 0)
+		{
+			work->failed[lane] = true;
+		}
+		SDL_LockMutex(work->lock);
+		++work->done;
+		SDL_UnlockMutex(work->lock);
+	}
+}
+
+// runs next to the caller, the frames are shared out among the pool
+static void obstacle_prewarm_job(void *data)
+{
+	struct ObstaclePrerender *work = data;
+	workers_parallel_for(work->lanes, obstacle_prerender_job, work);
+}
+
+static void obstacle_prewarm_cleanup(void)
+{
+	for (int j = 0; j < prewarm.fresh_num; ++j)
+	{
+		if (SDL_MUSTLOCK(obstacle_surfaces[prewarm.fresh[j]]))
+			SDL_UnlockSurface(obstacle_surfaces[prewarm.fresh[j]]);
+	}
+	for (int i = 0; i < prewarm.lanes; ++i)
+	{
+		if (prewarm.failed[i])
 		{
-			SDL_FreeSurface(obstacle_surfaces[i]);
-			obstacle_surfaces[i] = NULL;
+			printf("SVG_RasterizeWith: some saw frames were not drawn\n");
+			break;
 		}
 	}
+	if (prewarm.lock)
+		SDL_DestroyMutex(prewarm.lock);
+	free(prewarm.frames);
+	free(prewarm.fresh);
+	prewarm = (struct ObstaclePrerender) { .lock = NULL };
 }
 
-SDL_Surface *obstacle_get_surface(int radius, Uint32 color, int style)
+void obstacle_prewarm(const int *radii, int radii_num, Uint32 color, int style)
 {
-	if (NULL == obstacle_surfaces[radius])
+	// one at a time, the sheets of the earlier one are kept
+	obstacle_prewarm_finish();
+	obstacle_save_join();
+
+	int gears = obstacle_gears_num[style - 1];
+	float angle_delta = 5 * M_PI / (OBS_FRAMERATE * gears);
+	int frame_num = ceilf(2 * M_PI / (angle_delta * gears)) + 1;
+	prewarm = (struct ObstaclePrerender) {
+		.cr = (color >> 24) & 0xff,
+		.cg = (color >> 16) & 0xff,
+		.cb = (color >> 8) & 0xff,
+		.ca = color & 0xff,
+		.lanes = workers_count() + 1,
+		.fresh = malloc(radii_num * sizeof(int))
+	};
+
+	// the room to come sees only its own sheets
+	for (int i = 0; i < OBS_SHEETS_COUNT; ++i)
+	{
+		obstacle_surfaces[i] = NULL;
+		obstacle_framelimits[i] = 1;
+	}
+	++sheets_clock;
+
+	if (NULL == obstacle_templates[style - 1])
 	{
 		char path[64];
+		sprintf(path, GFX_DIR "saw%d.svg", style);
+		obstacle_templates[style - 1] = SVG_Load(path);
+		if (NULL == obstacle_templates[style - 1])
+		{
+			printf("SVG_Load: %s\n", IMG_GetError());
+			obstacle_prewarm_cleanup();
+			return;
+		}
+		if (!sheetfile_hash(path, &obstacle_template_hashes[style - 1]))
+			obstacle_template_hashes[style - 1] = 0;
+	}
+
+	for (int i = 0; i < prewarm.lanes; ++i)
+	{
+		if (NULL == obstacle_rasterizers[i])
+			obstacle_rasterizers[i] = SVG_CreateRasterizer();
+		if (NULL == obstacle_rasterizers[i])
+		{
+			printf("SVG_CreateRasterizer: %s\n", IMG_GetError());
+			prewarm.lanes = i;
+			break;
+		}
+	}
+	prewarm.lock = SDL_CreateMutex();
+	if (0 == prewarm.lanes || NULL == prewarm.lock)
+	{
+		obstacle_prewarm_cleanup();
+		return;
+	}
+
+	// the cached ones are bound at once, the others are drawn
+	size_t fresh_bytes = 0;
+	bool wanted[OBS_SHEETS_COUNT] = { false };
+	for (int i = 0; i < radii_num; ++i)
+	{
+		const int radius = radii[i];
+		if (wanted[radius])
+			continue;
+		wanted[radius] = true;
+		struct ObstacleSheet *sheet = obstacle_sheet_find(style, radius, color);
+		if (sheet)
+		{
+			++sheets_stats.hits;
+			sheet->used = sheets_clock;
+			obstacle_surfaces[radius] = sheet->surface;
+			obstacle_framelimits[radius] = sheet->frames;
+			continue;
+		}
+		++sheets_stats.misses;
+		const int ssize = radius * 2 + 4;
+		fresh_bytes += (size_t)ssize * frame_num * ssize * 4;
+		prewarm.fresh[prewarm.fresh_num++] = radius;
+	}
+
+	// room is made before the new sheets are allocated
+	obstacle_sheets_evict(sheets_stats.budget > fresh_bytes ? sheets_stats.budget - fresh_bytes : 0);
+	if (0 == prewarm.fresh_num)
+	{
+		obstacle_prewarm_cleanup();
+		return;
+	}
+	if (sheets_num + prewarm.fresh_num > sheets_capacity)
+	{
+		sheets_capacity = sheets_num + prewarm.fresh_num + 16;
+		sheets = (struct ObstacleSheet *)realloc(sheets, sheets_capacity * sizeof(struct ObstacleSheet));
+	}
+
+	// the sheets are made here, the threads only fill the ones that
+	// were not saved by an earlier run
+	int drawn_num = 0;
+	for (int j = 0; j < prewarm.fresh_num; ++j)
+	{
+		const int radius = prewarm.fresh[j];
 		int ssize = radius * 2 + 4;
-		int cr = (color >> 24) & 0xff;
-		int cg = (color >> 16) & 0xff;
-		int cb = (color >> 8) & 0xff;
-		int ca = color & 0xff;
-		int gears = obstacle_gears_num[style - 1];
-		float angle_delta = 5 * M_PI / (OBS_FRAMERATE * gears);
-
-		int frame_num = ceilf(2 * M_PI / (angle_delta * gears)) + 1;
 		SDL_Surface *temp = SDL_CreateRGBSurface(0,
 			ssize * frame_num, ssize, 32,
 			0xff, 0xff00, 0xff0000, 0xff000000);
 		obstacle_surfaces[radius] = SDL_DisplayFormatAlpha(temp);
 		SDL_FreeSurface(temp);
+		const struct SheetKey key = {
+			.source_hash = obstacle_template_hashes[style - 1],
+			.color = color,
+			.style = style,
+			.radius = radius
+		};
+		int frames = 0;
+		if (sheetfile_load(&key, obstacle_surfaces[radius], &frames))
+		{
+			++sheets_stats.loaded;
+			obstacle_sheet_add(style, radius, color, frames);
+			continue;
+		}
 		SDL_FillRect(obstacle_surfaces[radius], NULL, 0);
+		prewarm.fresh[drawn_num++] = radius;
+	}
+	prewarm.fresh_num = drawn_num;
+	if (0 == prewarm.fresh_num)
+	{
+		obstacle_prewarm_cleanup();
+		return;
+	}
+	prewarm.style = style;
+	prewarm.color = color;
+	prewarm.image = obstacle_templates[style - 1];
 
-		sprintf(path, GFX_DIR "saw%d.svg", style);
-
+	// the frames differ only in the rotation given to the rasterizer
+	prewarm.frames = malloc(prewarm.fresh_num * frame_num * sizeof(struct ObstacleFrame));
+	for (int j = 0; j < prewarm.fresh_num; ++j)
+	{
 		float angle = 0;
 		int i = 0;
-		for (angle = 0, i = 0; angle < (2 * M_PI / gears); angle += angle_delta, ++i)
+		for (angle = 0, i = 0; angle < (2 * M_PI / gears) && i < frame_num; angle += angle_delta, ++i)
 		{
-			SDL_Surface *temp2 = SVG_LoadSizedSVG_RW(path, ssize, ssize,
-				cr, cg, cb, ca, angle);
-			temp = SDL_DisplayFormatAlpha(temp2);
-			SDL_FreeSurface(temp2);
-
-			int bytes_num = obstacle_surfaces[radius]->pitch;
-			if (bytes_num > temp->pitch)
-				bytes_num = temp->pitch;
-			// funny thing, the heights below may be unequal
-			for (int y = 0; y < obstacle_surfaces[radius]->h && y < temp->h; ++y)
-			{
-				char *to = obstacle_surfaces[radius]->pixels;
-				char *from = temp->pixels;
-				int offset_to = y * obstacle_surfaces[radius]->pitch + (i * ssize * 4);
-				int offset_from = y * temp->pitch;
-				memcpy(to + offset_to, from + offset_from, bytes_num);
-			}
-			// I could not make the function below do simple copying
-			// SDL_BlitSurface(temp, NULL, obstacle_surfaces[radius], &dst);
-			SDL_FreeSurface(temp);
+			prewarm.frames[prewarm.frames_num++] = (struct ObstacleFrame) {
+				.radius = prewarm.fresh[j],
+				.index = i,
+				.angle = angle
+			};
 		}
-
 		// number of generated frames
-		obstacle_framelimits[radius] = i;
-		//printf("r=%d, limit=%d, frames=%d\n", radius, i, frame_num);
+		obstacle_sheet_add(style, prewarm.fresh[j], color, i);
+	}
+
+	for (int j = 0; j < prewarm.fresh_num; ++j)
+	{
+		if (SDL_MUSTLOCK(obstacle_surfaces[prewarm.fresh[j]]))
+			SDL_LockSurface(obstacle_surfaces[prewarm.fresh[j]]);
+	}
+	prewarm_pending = true;
+	workers_launch(obstacle_prewarm_job, &prewarm);
+}
+
+double obstacle_prewarm_progress(void)
+{
+	if (!prewarm_pending)
+		return 1.0;
+	SDL_LockMutex(prewarm.lock);
+	const int done = prewarm.done;
+	SDL_UnlockMutex(prewarm.lock);
+	return (double)done / prewarm.frames_num;
+}
+
+void obstacle_prewarm_finish(void)
+{
+	if (!prewarm_pending)
+		return;
+	workers_join();
+	prewarm_pending = false;
+	// the next run reads the sheets instead, unless some frame is missing
+	bool failed = false;
+	for (int i = 0; i < prewarm.lanes; ++i)
+	{
+		failed = failed || prewarm.failed[i];
+	}
+	saving.num = 0;
+	bool locked = false;
+	for (int j = 0; j < prewarm.fresh_num && !failed; ++j)
+	{
+		const int radius = prewarm.fresh[j];
+		saving.keys[saving.num] = (struct SheetKey) {
+			.source_hash = obstacle_template_hashes[prewarm.style - 1],
+			.color = prewarm.color,
+			.style = prewarm.style,
+			.radius = radius
+		};
+		saving.surfaces[saving.num] = obstacle_surfaces[radius];
+		saving.frames[saving.num] = obstacle_framelimits[radius];
+		locked = locked || SDL_MUSTLOCK(obstacle_surfaces[radius]);
+		++saving.num;
 	}
+	obstacle_prewarm_cleanup();
+	if (0 == saving.num)
+		return;
+
+	// the sheets are only read from now on, by the writer and the blits,
+	// the ones that have to be locked cannot be shared that way
+	if (locked)
+	{
+		obstacle_save_main(&saving);
+		return;
+	}
+	saver = SDL_CreateThread(obstacle_save_main, &saving);
+	if (NULL == saver)
+	{
+		// not critical, the loading just takes longer
+		printf("SDL_CreateThread: %s\n", SDL_GetError());
+		obstacle_save_main(&saving);
+	}
+}
+
+static int obstacle_save_main(void *data)
+{
+	struct ObstacleSave *save = data;
+	for (int i = 0; i < save->num; ++i)
+	{
+		if (!sheetfile_store(&save->keys[i], save->surfaces[i], save->frames[i]))
+			printf("sheetfile_store: could not save the sheet of radius %d\n", save->keys[i].radius);
+	}
+	sheetfile_prune(SHEET_FILES_BUDGET);
+	return 0;
+}
+
+static void obstacle_save_join(void)
+{
+	if (NULL == saver)
+		return;
+	SDL_WaitThread(saver, NULL);
+	saver = NULL;
+}
+
+SDL_Surface *obstacle_get_surface(int radius)
+{
+	if (prewarm_pending)
+		return NULL;
 	return obstacle_surfaces[radius];
 }
@@ -46,8 +46,34 @@ void parts_dispose(void);
 
 Uint32 get_wall_color(int hue);
 
+// the saw sheets are kept between the rooms, keyed by their look
+struct ObstacleCacheStats
+{
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int evictions;
+	unsigned int loaded;	// misses read from the sheet files
+	int sheets;
+	size_t bytes;
+	size_t budget;
+};
+
+// frees every cached sheet
 void obstacle_free_surfaces(void);
-// get and allocate/generate if needed
-SDL_Surface *obstacle_get_surface(int radius, Uint32 color, int style);
+// the sheets of the current room are kept even past the budget
+void obstacle_cache_budget(size_t bytes);
+void obstacle_cache_stats(struct ObstacleCacheStats *stats);
+// the sheets and the parsed styles
+void obstacle_dispose(void);
+// binds the sheets of the given sizes for the room to come, the ones not
+// in the cache are drawn in the background and shared out among the workers
+void obstacle_prewarm(const int *radii, int radii_num, Uint32 color, int style);
+// part of the frames drawn, 1 when there is nothing left to draw
+double obstacle_prewarm_progress(void);
+// waits for the prewarm to end, the sheets may be used after that, the
+// new ones are written to CACHE_DIR on a thread of their own meanwhile
+void obstacle_prewarm_finish(void);
+// never generates anything, NULL if the sheet is missing or not ready yet
+SDL_Surface *obstacle_get_surface(int radius);
 
 #endif
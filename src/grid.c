@@ -0,0 +1,368 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "grid.h"
+#include "game.h"
+
+static int grid_clamp(int value, int max);
+static struct GridRect grid_cells(const struct Grid *grid, double x1, double y1, double x2, double y2);
+static void grid_query_cells(const struct Grid *grid, const struct GridRect *q,
+	unsigned int mask, GridVisitor visit, void *data);
+static void grid_cell_add(struct GridCell *cell, const struct GridItem *item);
+static void grid_cell_del(struct GridCell *cell, const struct GridItem *item);
+static bool grid_visit_cell(const struct Grid *grid, int cx, int cy, int px, int py,
+	unsigned int mask, GridVisitor visit, void *data);
+static void grid_nearest_cell(const struct Grid *grid, int x, int y,
+	unsigned int mask, GridDistance distance, void *data, struct GridItem *nearest, double *best, bool *found);
+
+void grid_init(struct Grid *grid, const struct Vec2D *bb_min, const struct Vec2D *bb_max)
+{
+	grid->origin_x = bb_min->x;
+	grid->origin_y = bb_min->y;
+	grid->inv_cell_size = 1.0 / GRID_CELL_SIZE;
+	grid->cols = (int)ceil((bb_max->x - bb_min->x) * grid->inv_cell_size);
+	grid->rows = (int)ceil((bb_max->y - bb_min->y) * grid->inv_cell_size);
+	if (grid->cols < 1)
+		grid->cols = 1;
+	if (grid->rows < 1)
+		grid->rows = 1;
+	grid->cells = (struct GridCell *)calloc(grid->cols * grid->rows, sizeof(struct GridCell));
+}
+
+void grid_dispose(struct Grid *grid)
+{
+	if (grid->cells)
+	{
+		for (int i = 0; i < grid->cols * grid->rows; ++i)
+		{
+			free(grid->cells[i].items);
+		}
+		free(grid->cells);
+		grid->cells = NULL;
+	}
+	grid->cols = grid->rows = 0;
+}
+
+void grid_copy(struct Grid *dst, const struct Grid *src)
+{
+	const int num = src->cols * src->rows;
+	if (!dst->cells)
+		dst->cells = (struct GridCell *)calloc(num, sizeof(struct GridCell));
+	dst->origin_x = src->origin_x;
+	dst->origin_y = src->origin_y;
+	dst->inv_cell_size = src->inv_cell_size;
+	dst->cols = src->cols;
+	dst->rows = src->rows;
+	for (int i = 0; i < num; ++i)
+	{
+		struct GridCell *to = &dst->cells[i];
+		const struct GridCell *from = &src->cells[i];
+		if (to->capacity < from->num)
+		{
+			to->capacity = from->capacity;
+			to->items = (struct GridItem *)realloc(to->items,
+				to->capacity * sizeof(struct GridItem));
+		}
+		to->num = from->num;
+		if (from->num > 0)
+			memcpy(to->items, from->items, from->num * sizeof(struct GridItem));
+	}
+}
+
+// things outside of the grid are kept in the border cells
+static int grid_clamp(int value, int max)
+{
+	if (value < 0)
+		return 0;
+	if (value >= max)
+		return max - 1;
+	return value;
+}
+
+struct GridRect grid_rect(const struct Grid *grid, const struct Vec2D *pos, double r)
+{
+	const struct Vec2D bb_min = { .x = pos->x - r, .y = pos->y - r };
+	const struct Vec2D bb_max = { .x = pos->x + r, .y = pos->y + r };
+	return grid_box(grid, &bb_min, &bb_max);
+}
+
+struct GridRect grid_box(const struct Grid *grid, const struct Vec2D *bb_min, const struct Vec2D *bb_max)
+{
+	return grid_cells(grid, bb_min->x - GRID_MARGIN, bb_min->y - GRID_MARGIN,
+		bb_max->x + GRID_MARGIN, bb_max->y + GRID_MARGIN);
+}
+
+// cells covering the box exactly
+static struct GridRect grid_cells(const struct Grid *grid, double x1, double y1, double x2, double y2)
+{
+	struct GridRect rect = {
+		.x1 = grid_clamp(floor((x1 - grid->origin_x) * grid->inv_cell_size), grid->cols),
+		.y1 = grid_clamp(floor((y1 - grid->origin_y) * grid->inv_cell_size), grid->rows),
+		.x2 = grid_clamp(floor((x2 - grid->origin_x) * grid->inv_cell_size), grid->cols),
+		.y2 = grid_clamp(floor((y2 - grid->origin_y) * grid->inv_cell_size), grid->rows)
+	};
+	return rect;
+}
+
+bool grid_rect_equal(const struct GridRect *rect1, const struct GridRect *rect2)
+{
+	return rect1->x1 == rect2->x1 && rect1->y1 == rect2->y1 &&
+		rect1->x2 == rect2->x2 && rect1->y2 == rect2->y2;
+}
+
+static void grid_cell_add(struct GridCell *cell, const struct GridItem *item)
+{
+	if (cell->num == cell->capacity)
+	{
+		cell->capacity = cell->capacity ? cell->capacity * 2 : 8;
+		cell->items = (struct GridItem *)realloc(cell->items,
+			cell->capacity * sizeof(struct GridItem));
+	}
+	cell->items[cell->num++] = *item;
+}
+
+static void grid_cell_del(struct GridCell *cell, const struct GridItem *item)
+{
+	for (int i = 0; i < cell->num; ++i)
+	{
+		struct GridItem *it = &cell->items[i];
+		if (it->type == item->type && it->owner == item->owner && it->index == item->index)
+		{
+			*it = cell->items[--cell->num];
+			return;
+		}
+	}
+}
+
+void grid_insert(struct Grid *grid, const struct GridRect *rect,
+	int type, int owner, int index)
+{
+	struct GridItem item = {
+		.type = type,
+		.owner = owner,
+		.index = index,
+		.rect = *rect
+	};
+	for (int y = rect->y1; y <= rect->y2; ++y)
+		for (int x = rect->x1; x <= rect->x2; ++x)
+		{
+			grid_cell_add(&grid->cells[y * grid->cols + x], &item);
+		}
+}
+
+void grid_remove(struct Grid *grid, const struct GridItem *item)
+{
+	const struct GridRect *rect = &item->rect;
+	for (int y = rect->y1; y <= rect->y2; ++y)
+		for (int x = rect->x1; x <= rect->x2; ++x)
+		{
+			grid_cell_del(&grid->cells[y * grid->cols + x], item);
+		}
+}
+
+void grid_update(struct Grid *grid, struct GridItem *item, const struct GridRect *rect)
+{
+	const bool registered = item->rect.x1 >= 0;
+	if (registered && rect && grid_rect_equal(&item->rect, rect))
+		return;
+	if (registered)
+	{
+		grid_remove(grid, item);
+		item->rect.x1 = -1;
+	}
+	if (rect)
+	{
+		grid_insert(grid, rect, item->type, item->owner, item->index);
+		item->rect = *rect;
+	}
+}
+
+const struct GridCell* grid_cell(const struct Grid *grid, const struct Vec2D *pos)
+{
+	int x = grid_clamp(floor((pos->x - grid->origin_x) * grid->inv_cell_size), grid->cols);
+	int y = grid_clamp(floor((pos->y - grid->origin_y) * grid->inv_cell_size), grid->rows);
+	return &grid->cells[y * grid->cols + x];
+}
+
+void grid_query_circle(const struct Grid *grid, const struct Vec2D *pos, double reach,
+	unsigned int mask, GridVisitor visit, void *data)
+{
+	// items are registered with the margin already, so the query itself
+	// only has to cover what is left of the reach
+	const double r = reach > GRID_MARGIN ? reach - GRID_MARGIN : 0;
+	const struct GridRect q = grid_cells(grid, pos->x - r, pos->y - r, pos->x + r, pos->y + r);
+	grid_query_cells(grid, &q, mask, visit, data);
+}
+
+void grid_query_box(const struct Grid *grid, const struct Vec2D *bb_min, const struct Vec2D *bb_max,
+	unsigned int mask, GridVisitor visit, void *data)
+{
+	const struct GridRect q = grid_cells(grid, bb_min->x, bb_min->y, bb_max->x, bb_max->y);
+	grid_query_cells(grid, &q, mask, visit, data);
+}
+
+static void grid_query_cells(const struct Grid *grid, const struct GridRect *q,
+	unsigned int mask, GridVisitor visit, void *data)
+{
+	for (int y = q->y1; y <= q->y2; ++y)
+		for (int x = q->x1; x <= q->x2; ++x)
+		{
+			const struct GridCell *cell = &grid->cells[y * grid->cols + x];
+			for (int i = 0; i < cell->num; ++i)
+			{
+				const struct GridItem *item = &cell->items[i];
+				if (!(mask & GRID_MASK(item->type)))
+					continue;
+				// report only in the first cell shared with the query
+				if (x != (item->rect.x1 > q->x1 ? item->rect.x1 : q->x1) ||
+					y != (item->rect.y1 > q->y1 ? item->rect.y1 : q->y1))
+					continue;
+				if (!visit(item, data))
+					return;
+			}
+		}
+}
+
+// (px, py) is the previously visited cell, items seen there are skipped
+static bool grid_visit_cell(const struct Grid *grid, int cx, int cy, int px, int py,
+	unsigned int mask, GridVisitor visit, void *data)
+{
+	const struct GridCell *cell = &grid->cells[cy * grid->cols + cx];
+	for (int i = 0; i < cell->num; ++i)
+	{
+		const struct GridItem *item = &cell->items[i];
+		if (!(mask & GRID_MASK(item->type)))
+			continue;
+		if (px >= item->rect.x1 && px <= item->rect.x2 &&
+			py >= item->rect.y1 && py <= item->rect.y2)
+			continue;
+		if (!visit(item, data))
+			return false;
+	}
+	return true;
+}
+
+void grid_query_ray(const struct Grid *grid, const struct Vec2D *from, const struct Vec2D *to,
+	unsigned int mask, GridVisitor visit, void *data)
+{
+	// cell traversal by Amanatides & Woo, the path is monotone in both axes
+	// so it enters the range of cells of any item only once
+	const double x0 = (from->x - grid->origin_x) * grid->inv_cell_size;
+	const double y0 = (from->y - grid->origin_y) * grid->inv_cell_size;
+	const double x1 = (to->x - grid->origin_x) * grid->inv_cell_size;
+	const double y1 = (to->y - grid->origin_y) * grid->inv_cell_size;
+	int cx = floor(x0);
+	int cy = floor(y0);
+	const int ex = floor(x1);
+	const int ey = floor(y1);
+	// the direction of the ray, the cells may stay the same on an axis
+	// while it still moves along it
+	const int stepx = x1 > x0 ? 1 : -1;
+	const int stepy = y1 > y0 ? 1 : -1;
+	const double tdeltax = x1 != x0 ? 1.0 / fabs(x1 - x0) : INFINITY;
+	const double tdeltay = y1 != y0 ? 1.0 / fabs(y1 - y0) : INFINITY;
+	double tmaxx = x1 != x0 ? (stepx > 0 ? cx + 1 - x0 : x0 - cx) * tdeltax : INFINITY;
+	double tmaxy = y1 != y0 ? (stepy > 0 ? cy + 1 - y0 : y0 - cy) * tdeltay : INFINITY;
+	int steps = abs(ex - cx) + abs(ey - cy);
+
+	int px = -1;
+	int py = -1;
+	while (true)
+	{
+		const int vx = grid_clamp(cx, grid->cols);
+		const int vy = grid_clamp(cy, grid->rows);
+		if (vx != px || vy != py)
+		{
+			if (!grid_visit_cell(grid, vx, vy, px, py, mask, visit, data))
+				return;
+			px = vx;
+			py = vy;
+		}
+		if (steps-- <= 0)
+			break;
+		if (tmaxx < tmaxy)
+		{
+			cx += stepx;
+			tmaxx += tdeltax;
+		}
+		else
+		{
+			cy += stepy;
+			tmaxy += tdeltay;
+		}
+	}
+}
+
+static void grid_nearest_cell(const struct Grid *grid, int x, int y,
+	unsigned int mask, GridDistance distance, void *data, struct GridItem *nearest, double *best, bool *found)
+{
+	if (x < 0 || y < 0 || x >= grid->cols || y >= grid->rows)
+		return;
+	const struct GridCell *cell = &grid->cells[y * grid->cols + x];
+	for (int i = 0; i < cell->num; ++i)
+	{
+		const struct GridItem *item = &cell->items[i];
+		if (!(mask & GRID_MASK(item->type)))
+			continue;
+		// an item spanning more cells is seen again, that does no harm
+		const double dist = distance(item, data);
+		if (dist < 0)
+			continue;
+		if (!*found || dist < *best || (dist == *best && item->index < nearest->index))
+		{
+			*best = dist;
+			*nearest = *item;
+			*found = true;
+		}
+	}
+}
+
+bool grid_nearest(const struct Grid *grid, const struct Vec2D *pos,
+	unsigned int mask, GridDistance distance, void *data, struct GridItem *nearest)
+{
+	const int cx = grid_clamp(floor((pos->x - grid->origin_x) * grid->inv_cell_size), grid->cols);
+	const int cy = grid_clamp(floor((pos->y - grid->origin_y) * grid->inv_cell_size), grid->rows);
+	// no infinities, the MIYOO build assumes finite math
+	double best = 0;
+	bool found = false;
+	for (int k = 0; ; ++k)
+	{
+		const int x1 = cx - k;
+		const int y1 = cy - k;
+		const int x2 = cx + k;
+		const int y2 = cy + k;
+		for (int x = x1; x <= x2; ++x)
+		{
+			grid_nearest_cell(grid, x, y1, mask, distance, data, nearest, &best, &found);
+			if (k > 0)
+				grid_nearest_cell(grid, x, y2, mask, distance, data, nearest, &best, &found);
+		}
+		for (int y = y1 + 1; y < y2; ++y)
+		{
+			grid_nearest_cell(grid, x1, y, mask, distance, data, nearest, &best, &found);
+			grid_nearest_cell(grid, x2, y, mask, distance, data, nearest, &best, &found);
+		}
+
+		// the border cells keep what is outside of the grid, so nothing
+		// is past them once the rings cover it all
+		if (x1 <= 0 && y1 <= 0 && x2 >= grid->cols - 1 && y2 >= grid->rows - 1)
+			break;
+		if (!found)
+			continue;
+		// anything not seen yet is beyond the cells searched, at least
+		// one side is still open here
+		double bound = DBL_MAX;
+		if (x1 > 0)
+			bound = fmin(bound, pos->x - (grid->origin_x + x1 * GRID_CELL_SIZE));
+		if (y1 > 0)
+			bound = fmin(bound, pos->y - (grid->origin_y + y1 * GRID_CELL_SIZE));
+		if (x2 < grid->cols - 1)
+			bound = fmin(bound, grid->origin_x + (x2 + 1) * GRID_CELL_SIZE - pos->x);
+		if (y2 < grid->rows - 1)
+			bound = fmin(bound, grid->origin_y + (y2 + 1) * GRID_CELL_SIZE - pos->y);
+		if (bound > 0 && bound * bound > best)
+			break;
+	}
+	return found;
+}
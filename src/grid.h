@@ -0,0 +1,99 @@
+#ifndef _H_GRID
+#define _H_GRID
+
+#include <stdbool.h>
+
+#define GRID_CELL_SIZE					(32.0)
+// items are registered with their radius increased by this value,
+// so a single cell holds everything that any probe of that radius
+// placed inside the cell can touch
+#define GRID_MARGIN						(5.0)
+#define GRID_MASK(type)					(1u << (type))
+#define GRID_MASK_ALL					(~0u)
+
+struct Vec2D;
+
+enum GridItemType
+{
+	GI_HEAD,
+	GI_BODY,
+	GI_OBSTACLE,
+	GI_CONSUMABLE,
+	GI_WALL,
+	GI_END
+};
+
+// inclusive range of cells, x1 < 0 means "not registered"
+struct GridRect
+{
+	short x1, y1;
+	short x2, y2;
+};
+
+struct GridItem
+{
+	short type;
+	short owner;	// snake number for heads and bodies
+	int index;		// sample number for bodies, entity number otherwise
+	struct GridRect rect;
+};
+
+struct GridCell
+{
+	int num;
+	int capacity;
+	struct GridItem *items;
+};
+
+struct Grid
+{
+	double origin_x;
+	double origin_y;
+	double inv_cell_size;
+	int cols;
+	int rows;
+	struct GridCell *cells;
+};
+
+// return false to stop the query
+typedef bool (*GridVisitor)(const struct GridItem *item, void *data);
+// squared distance to a point of the item inside its cells, negative
+// to pass the item over
+typedef double (*GridDistance)(const struct GridItem *item, void *data);
+
+void grid_init(struct Grid *grid, const struct Vec2D *bb_min, const struct Vec2D *bb_max);
+void grid_dispose(struct Grid *grid);
+// dst is zeroed or a copy of a grid of the same size
+void grid_copy(struct Grid *dst, const struct Grid *src);
+
+// cells covered by a circle with the margin added
+struct GridRect grid_rect(const struct Grid *grid, const struct Vec2D *pos, double r);
+// cells covered by a bounding box with the margin added
+struct GridRect grid_box(const struct Grid *grid, const struct Vec2D *bb_min, const struct Vec2D *bb_max);
+bool grid_rect_equal(const struct GridRect *rect1, const struct GridRect *rect2);
+void grid_insert(struct Grid *grid, const struct GridRect *rect,
+	int type, int owner, int index);
+void grid_remove(struct Grid *grid, const struct GridItem *item);
+// keeps the registration in *item up to date, NULL rect removes it
+void grid_update(struct Grid *grid, struct GridItem *item, const struct GridRect *rect);
+
+// everything that may be touched by a probe of radius up to GRID_MARGIN
+const struct GridCell* grid_cell(const struct Grid *grid, const struct Vec2D *pos);
+// every item that may be closer than reach to pos, each visited once
+void grid_query_circle(const struct Grid *grid, const struct Vec2D *pos, double reach,
+	unsigned int mask, GridVisitor visit, void *data);
+// every item that may be touched by a probe of radius up to GRID_MARGIN
+// placed anywhere within the box, each visited once
+void grid_query_box(const struct Grid *grid, const struct Vec2D *bb_min, const struct Vec2D *bb_max,
+	unsigned int mask, GridVisitor visit, void *data);
+// every item that may be touched by a probe of radius up to GRID_MARGIN
+// swept from one point to another, each visited once, nearer cells first
+void grid_query_ray(const struct Grid *grid, const struct Vec2D *from, const struct Vec2D *to,
+	unsigned int mask, GridVisitor visit, void *data);
+// the item nearest to pos, the cells are searched in rings around it
+// until nothing nearer can be left, ties go to the lower index,
+// false if there is no such item
+bool grid_nearest(const struct Grid *grid, const struct Vec2D *pos,
+	unsigned int mask, GridDistance distance, void *data, struct GridItem *nearest);
+
+#endif
@@ -3,13 +3,16 @@
 #include <SDL_image.h>
 #include <SDL_gfxPrimitives.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <math.h>
 #include "main.h"
 #include "game.h"
 #include "gfx.h"
+#include "workers.h"
 
 // maximum number of settings per option
-#define MENU_SETTINGS_MAX			(3)
+#define MENU_SETTINGS_MAX			(5)
 #define MENU_SETTING_STR_LEN_MAX	(16)
 #define WORD_WRAP_MAX_LINE_LEN		(40)
 
@@ -26,13 +29,21 @@ int gamestate = GS_MENU;
 Mix_Chunk *sfx_chunks[ST_END] = { NULL };
 
 int menu_options[MO_NUM];
-int menu_options_num[MO_NUM] = {LT_NUM, W_NUM};
+// every game is played from this seed when it is given with --seed
+static bool seed_fixed = false;
+static unsigned int seed_fixed_value = 0;
+// memory for the saw sheets kept between the games, --sheet-cache in KiB
+static size_t sheet_cache_budget = SHEET_CACHE_BUDGET;
+int menu_options_num[MO_NUM] = {LT_NUM, W_NUM, AM_NUM};
 const char menu_options_text[MO_NUM][MENU_SETTINGS_MAX][MENU_SETTING_STR_LEN_MAX] = {
 	{
-		"cage", "polygon", "star"
+		"cage", "polygon", "star", "arena", "feast"
 	},
 	{
 		"absteiner", "normie", "boozer"
+	},
+	{
+		"dumb", "planner"
 	}
 };
 
@@ -45,6 +56,18 @@ void wrap_text_lines(char *text);
 
 int main(int argc, char *argv[])
 {
+	for (int i = 1; i < argc; ++i)
+	{
+		if (0 == strcmp(argv[i], "--seed") && i + 1 < argc)
+		{
+			seed_fixed = true;
+			seed_fixed_value = strtoul(argv[++i], NULL, 10);
+		}
+		else if (0 == strcmp(argv[i], "--sheet-cache") && i + 1 < argc)
+		{
+			sheet_cache_budget = (size_t)strtoul(argv[++i], NULL, 10) << 10;
+		}
+	}
 	srand(time(NULL));
 	SDL_CHECK(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_AUDIO) < 0);
 #if defined(MIYOO)
@@ -116,6 +139,8 @@ int main(int argc, char *argv[])
 	tiles_init();
 	food_init();
 	parts_init();
+	workers_init(WORKER_THREADS);
+	obstacle_cache_budget(sheet_cache_budget);
 
 	while (GS_QUIT != gamestate)
 	{
@@ -136,6 +161,8 @@ int main(int argc, char *argv[])
 		};
 	}
 
+	workers_dispose();
+	obstacle_dispose();
 	return 0;
 }
 
@@ -183,6 +210,13 @@ void gs_menu_process(void)
 		stringRGBA(screen, SCREEN_WIDTH / 2 + (SCREEN_WIDTH / 2 - 8 * strlen(text)) / 2,
 			SCREEN_HEIGHT - 8 - 61, text, 255, 255, 255, 255);
 
+		sprintf(text, "%c AI", MO_AI == selection ? '>' : ' ');
+		stringRGBA(screen, (SCREEN_WIDTH / 2 - 8 * strlen(text)) / 2,
+			SCREEN_HEIGHT - 8 - 45, text, 255, 255, 255, 255);
+		sprintf(text, "%s", menu_options_text[MO_AI][menu_options[MO_AI]]);
+		stringRGBA(screen, SCREEN_WIDTH / 2 + (SCREEN_WIDTH / 2 - 8 * strlen(text)) / 2,
+			SCREEN_HEIGHT - 8 - 45, text, 255, 255, 255, 255);
+
 		sprintf(text, "by vamastah aka szymor");
 		stringRGBA(screen, (SCREEN_WIDTH - 8 * strlen(text)) / 2,
 			SCREEN_HEIGHT - 8 - 24, text, 255, 255, 255, 255);
@@ -244,24 +278,39 @@ void gs_game_process(void)
 {
 	bool ai = false;
 	bool paused = false;
-	// game data init
-	srand(time(NULL));
+	// game data init, the seed is printed so the game can be played again
+	const unsigned int seed = seed_fixed ? seed_fixed_value : (unsigned int)time(NULL);
+	printf("seed: %u\n", seed);
 	enum CameraMode cm = CM_FIXED;
 	struct Room room;
-	room_init(&room);
+	room_init(&room, seed);
 
-	// loading screen
-	SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
+	// loading screen, it stays until the saws are drawn
 	const char loading_text[] = "LOADING...";
-	stringRGBA(screen, (SCREEN_WIDTH - 8 * strlen(loading_text)) / 2,
-		(SCREEN_HEIGHT - 8) / 2, loading_text, 255, 255, 255, 255);
-	SDL_Flip(screen);
-
-	room_draw(&room);	// workaround for SVG prerendering phase
+	const int bar_w = SCREEN_WIDTH / 2;
+	const int bar_x = (SCREEN_WIDTH - bar_w) / 2;
+	const int bar_y = SCREEN_HEIGHT / 2 + 8;
+	double progress = 0;
+	do
+	{
+		progress = obstacle_prewarm_progress();
+		SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
+		stringRGBA(screen, (SCREEN_WIDTH - 8 * strlen(loading_text)) / 2,
+			(SCREEN_HEIGHT - 8) / 2, loading_text, 255, 255, 255, 255);
+		rectangleRGBA(screen, bar_x, bar_y, bar_x + bar_w, bar_y + 6, 255, 255, 255, 255);
+		boxRGBA(screen, bar_x + 2, bar_y + 2, bar_x + 2 + (bar_w - 4) * progress, bar_y + 4,
+			255, 255, 255, 255);
+		SDL_Flip(screen);
+		if (progress < 1.0)
+			SDL_Delay(10);
+	} while (progress < 1.0);
+	// frees the background thread for the planner
+	obstacle_prewarm_finish();
 
 	SDL_Event event;
 	bool leave = false;
 	Uint32 prevtime = SDL_GetTicks();
+	double accumulator = 0;
 	while (!leave)
 	{
 		if (SDL_PollEvent(&event))
@@ -322,10 +371,21 @@ void gs_game_process(void)
 			fps_counter(dt);
 			if (!paused)
 			{
-				room_process(&room, dt, ai);
-				camera_process(dt);
+				accumulator += dt;
+				int steps = 0;
+				while (accumulator >= SIM_TIMESTEP && steps < SIM_MAX_STEPS &&
+					!room_check_gameover(&room))
+				{
+					room_process(&room, SIM_TIMESTEP, ai);
+					camera_process(SIM_TIMESTEP);
+					accumulator -= SIM_TIMESTEP;
+					++steps;
+				}
+				// too long hitch - drop the time we could not catch up with
+				if (accumulator >= SIM_TIMESTEP)
+					accumulator = fmod(accumulator, SIM_TIMESTEP);
 			}
-			room_draw(&room);
+			room_draw(&room, accumulator / SIM_TIMESTEP);
 			//fps_draw();
 			pause_draw(paused);
 			SDL_Flip(screen);
@@ -339,7 +399,12 @@ void gs_game_process(void)
 		}
 	}
 	room_dispose(&room);
-	obstacle_free_surfaces();
+	// the sheets stay for the next game
+	struct ObstacleCacheStats stats;
+	obstacle_cache_stats(&stats);
+	printf("saw sheets: %u hits, %u misses (%u read), %u evicted, %d kept, %zu of %zu KiB\n",
+		stats.hits, stats.misses, stats.loaded, stats.evictions, stats.sheets,
+		stats.bytes >> 10, stats.budget >> 10);
 }
 
 void gs_gameover_process(void)
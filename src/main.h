@@ -11,9 +11,22 @@
 #define SCREEN_HEIGHT					(240)
 #define SCREEN_BPP						(16)
 #define FPS_LIMIT						(60)
+// the AI thread decides one step behind the simulation, next to the workers
+#if defined(MIYOO)
+#define WORKER_THREADS					(0)
+#define AI_THREAD						(0)
+#define SHEET_CACHE_BUDGET				(6 << 20)
+#define SHEET_FILES_BUDGET				(32 << 20)
+#else
+#define WORKER_THREADS					(3)
+#define AI_THREAD						(1)
+#define SHEET_CACHE_BUDGET				(64 << 20)
+#define SHEET_FILES_BUDGET				(256 << 20)
+#endif
 
 #define GFX_DIR							"gfx/"
 #define SFX_DIR							"sfx/"
+#define CACHE_DIR						"cache/"
 
 #define KEY_LEFT						SDLK_LEFT
 #define KEY_RIGHT						SDLK_RIGHT
@@ -54,6 +67,8 @@ enum LevelType
 	LT_CAGE,
 	LT_POLYGON,
 	LT_STAR,
+	LT_ARENA,
+	LT_FEAST,
 	LT_NUM
 };
 
@@ -65,10 +80,18 @@ enum Wobbliness
 	W_NUM
 };
 
+enum AiMode
+{
+	AM_DUMB,
+	AM_PLANNER,
+	AM_NUM
+};
+
 enum MenuOptions
 {
 	MO_LEVELTYPE,
 	MO_WOBBLINESS,
+	MO_AI,
 	MO_NUM
 };
 
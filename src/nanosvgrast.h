@@ -65,6 +65,13 @@ void nsvgRasterize(NSVGrasterizer* r,
 				   unsigned char* dst, int w, int h, int stride,
 				   int cr, int cg, int cb, int ca);
 
+// As nsvgRasterize, the image is also rotated by angle (radians) about
+// the centre of its scaled bounds, gradients are not rotated
+void nsvgRasterizeRotated(NSVGrasterizer* r,
+				   NSVGimage* image, float tx, float ty, float scale, float angle,
+				   unsigned char* dst, int w, int h, int stride,
+				   int cr, int cg, int cb, int ca);
+
 // Deletes rasterizer context.
 void nsvgDeleteRasterizer(NSVGrasterizer*);
 
@@ -149,6 +156,10 @@ struct NSVGrasterizer
 
 	unsigned char* bitmap;
 	int width, height, stride;
+
+	// rotation of the scaled points about (rotCx, rotCy)
+	float rotCos, rotSin;
+	float rotCx, rotCy;
 };
 
 NSVGrasterizer* nsvgCreateRasterizer(void)
@@ -159,6 +170,7 @@ NSVGrasterizer* nsvgCreateRasterizer(void)
 
 	r->tessTol = 0.25f;
 	r->distTol = 0.01f;
+	r->rotCos = 1.0f;
 
 	return r;
 
@@ -371,21 +383,50 @@ static void nsvg__flattenCubicBez(NSVGrasterizer* r,
 	nsvg__flattenCubicBez(r, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
 }
 
+// Scales the points and rotates them when a rotation is set, the curves
+// are flattened the same whichever way they are turned
+static void nsvg__placePoints(NSVGrasterizer* r, const float* p, int n, float scale, float* q)
+{
+	int i;
+	if (r->rotSin == 0.0f && r->rotCos == 1.0f) {
+		for (i = 0; i < n*2; i++)
+			q[i] = p[i]*scale;
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		float x = p[i*2]*scale - r->rotCx;
+		float y = p[i*2+1]*scale - r->rotCy;
+		q[i*2] = r->rotCx + x*r->rotCos - y*r->rotSin;
+		q[i*2+1] = r->rotCy + x*r->rotSin + y*r->rotCos;
+	}
+}
+
+static void nsvg__flattenPath(NSVGrasterizer* r, NSVGpath* path, float scale, int type)
+{
+	int i;
+	float q[8];
+
+	nsvg__placePoints(r, path->pts, 1, scale, q);
+	nsvg__addPathPoint(r, q[0], q[1], type);
+	for (i = 0; i < path->npts-1; i += 3) {
+		nsvg__placePoints(r, &path->pts[i*2], 4, scale, q);
+		nsvg__flattenCubicBez(r, q[0],q[1], q[2],q[3], q[4],q[5], q[6],q[7], 0, type);
+	}
+}
+
 static void nsvg__flattenShape(NSVGrasterizer* r, NSVGshape* shape, float scale)
 {
 	int i, j;
 	NSVGpath* path;
+	float q[2];
 
 	for (path = shape->paths; path != NULL; path = path->next) {
 		r->npoints = 0;
 		// Flatten path
-		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, 0);
-		for (i = 0; i < path->npts-1; i += 3) {
-			float* p = &path->pts[i*2];
-			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, 0, 0);
-		}
+		nsvg__flattenPath(r, path, scale, 0);
 		// Close path
-		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, 0);
+		nsvg__placePoints(r, path->pts, 1, scale, q);
+		nsvg__addPathPoint(r, q[0], q[1], 0);
 		// Build edges
 		for (i = 0, j = r->npoints-1; i < r->npoints; j = i++)
 			nsvg__addEdge(r, r->points[j].x, r->points[j].y, r->points[i].x, r->points[i].y);
@@ -737,7 +778,7 @@ static void nsvg__prepareStroke(NSVGrasterizer* r, float miterLimit, int lineJoi
 
 static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float scale)
 {
-	int i, j, closed;
+	int j, closed;
 	NSVGpath* path;
 	NSVGpoint* p0, *p1;
 	float miterLimit = shape->miterLimit;
@@ -748,11 +789,7 @@ static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float
 	for (path = shape->paths; path != NULL; path = path->next) {
 		// Flatten path
 		r->npoints = 0;
-		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, NSVG_PT_CORNER);
-		for (i = 0; i < path->npts-1; i += 3) {
-			float* p = &path->pts[i*2];
-			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, 0, NSVG_PT_CORNER);
-		}
+		nsvg__flattenPath(r, path, scale, NSVG_PT_CORNER);
 		if (r->npoints < 2)
 			continue;
 
@@ -1369,12 +1406,29 @@ void nsvgRasterize(NSVGrasterizer* r,
 				   NSVGimage* image, float tx, float ty, float scale,
 				   unsigned char* dst, int w, int h, int stride,
 				   int cr, int cg, int cb, int ca)
+{
+	nsvgRasterizeRotated(r, image, tx, ty, scale, 0.0f, dst, w, h, stride, cr, cg, cb, ca);
+}
+
+void nsvgRasterizeRotated(NSVGrasterizer* r,
+				   NSVGimage* image, float tx, float ty, float scale, float angle,
+				   unsigned char* dst, int w, int h, int stride,
+				   int cr, int cg, int cb, int ca)
 {
 	NSVGshape *shape = NULL;
 	NSVGedge *e = NULL;
 	NSVGcachedPaint cache;
 	int i;
 
+	r->rotCos = 1.0f;
+	r->rotSin = 0.0f;
+	if (angle != 0.0f) {
+		r->rotCos = cosf(angle);
+		r->rotSin = sinf(angle);
+	}
+	r->rotCx = image->width * scale * 0.5f;
+	r->rotCy = image->height * scale * 0.5f;
+
 	r->bitmap = dst;
 	r->width = w;
 	r->height = h;
@@ -1395,10 +1449,12 @@ void nsvgRasterize(NSVGrasterizer* r,
 
 		if (shape->fill.type != NSVG_PAINT_NONE) {
 
-			// recolor hack
-			if (shape->fill.type == NSVG_PAINT_COLOR)
+			// recolor hack, on a copy so the image is only read and
+			// may be shared by rasterizers on other threads
+			NSVGpaint fill = shape->fill;
+			if (fill.type == NSVG_PAINT_COLOR)
 			{
-				shape->fill.color = nsvg__RGBA(cr, cg, cb, ca);
+				fill.color = nsvg__RGBA(cr, cg, cb, ca);
 			}
 
 			nsvg__resetPool(r);
@@ -1421,7 +1477,7 @@ void nsvgRasterize(NSVGrasterizer* r,
 				qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
 
 			// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
-			nsvg__initPaint(&cache, &shape->fill, shape->opacity);
+			nsvg__initPaint(&cache, &fill, shape->opacity);
 
 			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, shape->fillRule);
 		}
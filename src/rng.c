@@ -0,0 +1,38 @@
+#include "rng.h"
+
+void rng_seed(struct Rng *rng, uint64_t seed, uint64_t stream)
+{
+	rng->state = 0;
+	rng->inc = (stream << 1) | 1u;
+	rng_next(rng);
+	rng->state += seed;
+	rng_next(rng);
+}
+
+uint32_t rng_next(struct Rng *rng)
+{
+	const uint64_t old = rng->state;
+	rng->state = old * 6364136223846793005ULL + rng->inc;
+	const uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+	const uint32_t rot = (uint32_t)(old >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// multiply and shift, the few values that would favour the lower
+// results are drawn again
+int rng_int(struct Rng *rng, int n)
+{
+	const uint32_t range = (uint32_t)n;
+	const uint32_t threshold = -range % range;
+	for (;;)
+	{
+		const uint64_t m = (uint64_t)rng_next(rng) * range;
+		if ((uint32_t)m >= threshold)
+			return (int)(m >> 32);
+	}
+}
+
+double rng_double(struct Rng *rng)
+{
+	return rng_next(rng) * (1.0 / 4294967296.0);
+}
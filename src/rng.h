@@ -0,0 +1,21 @@
+#ifndef _H_RNG
+#define _H_RNG
+
+#include <stdint.h>
+
+// PCG32 generator, the same seed gives the same numbers everywhere and
+// generators seeded alike on different streams are independent
+struct Rng
+{
+	uint64_t state;
+	uint64_t inc;	// stream selector, always odd
+};
+
+void rng_seed(struct Rng *rng, uint64_t seed, uint64_t stream);
+uint32_t rng_next(struct Rng *rng);
+// uniform in [0, n), n > 0
+int rng_int(struct Rng *rng, int n);
+// uniform in [0, 1)
+double rng_double(struct Rng *rng);
+
+#endif
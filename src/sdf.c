@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sdf.h"
+#include "game.h"
+
+#define SDF_MAX_SAMPLE					((short)(SDF_MAX_DIST * SDF_SCALE))
+// no point of a cell is farther than this from any of its corners,
+// the distance is 1-Lipschitz so the interpolation is never off by more
+#define SDF_SLACK						(SDF_CELL_SIZE * M_SQRT2)
+
+struct SampleRange
+{
+	int x1, y1;
+	int x2, y2;
+};
+
+static bool sdf_range(const struct DistanceField *field,
+	const struct Vec2D *bb_min, const struct Vec2D *bb_max,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max,
+	struct SampleRange *range);
+static void sdf_store(struct DistanceField *field, int x, int y, double dist);
+
+void sdf_init(struct DistanceField *field, const struct Vec2D *bb_min, const struct Vec2D *bb_max)
+{
+	field->origin_x = bb_min->x;
+	field->origin_y = bb_min->y;
+	field->inv_cell_size = 1.0 / SDF_CELL_SIZE;
+	field->cols = (int)ceil((bb_max->x - bb_min->x) * field->inv_cell_size) + 1;
+	field->rows = (int)ceil((bb_max->y - bb_min->y) * field->inv_cell_size) + 1;
+	if (field->cols < 2)
+		field->cols = 2;
+	if (field->rows < 2)
+		field->rows = 2;
+	field->dist = (short *)malloc(field->cols * field->rows * sizeof(short));
+	field->changes = 0;
+	sdf_clear(field, NULL, NULL);
+}
+
+void sdf_dispose(struct DistanceField *field)
+{
+	free(field->dist);
+	field->dist = NULL;
+	field->cols = field->rows = 0;
+}
+
+void sdf_copy(struct DistanceField *dst, const struct DistanceField *src)
+{
+	if (dst->dist && dst->changes == src->changes)
+		return;
+	const int num = src->cols * src->rows;
+	if (!dst->dist)
+		dst->dist = (short *)malloc(num * sizeof(short));
+	dst->origin_x = src->origin_x;
+	dst->origin_y = src->origin_y;
+	dst->inv_cell_size = src->inv_cell_size;
+	dst->cols = src->cols;
+	dst->rows = src->rows;
+	dst->changes = src->changes;
+	memcpy(dst->dist, src->dist, num * sizeof(short));
+}
+
+// samples within the box, returns false if there are none
+static bool sdf_range(const struct DistanceField *field,
+	const struct Vec2D *bb_min, const struct Vec2D *bb_max,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max,
+	struct SampleRange *range)
+{
+	double x1 = bb_min->x;
+	double y1 = bb_min->y;
+	double x2 = bb_max->x;
+	double y2 = bb_max->y;
+	if (clip_min)
+	{
+		x1 = fmax(x1, clip_min->x);
+		y1 = fmax(y1, clip_min->y);
+	}
+	if (clip_max)
+	{
+		x2 = fmin(x2, clip_max->x);
+		y2 = fmin(y2, clip_max->y);
+	}
+	range->x1 = (int)fmax(ceil((x1 - field->origin_x) * field->inv_cell_size), 0);
+	range->y1 = (int)fmax(ceil((y1 - field->origin_y) * field->inv_cell_size), 0);
+	range->x2 = (int)fmin(floor((x2 - field->origin_x) * field->inv_cell_size), field->cols - 1);
+	range->y2 = (int)fmin(floor((y2 - field->origin_y) * field->inv_cell_size), field->rows - 1);
+	return range->x1 <= range->x2 && range->y1 <= range->y2;
+}
+
+static void sdf_store(struct DistanceField *field, int x, int y, double dist)
+{
+	double q = floor(dist * SDF_SCALE);
+	if (q > SDF_MAX_SAMPLE)
+		q = SDF_MAX_SAMPLE;
+	else if (q < -SDF_MAX_SAMPLE)
+		q = -SDF_MAX_SAMPLE;
+	short *sample = &field->dist[y * field->cols + x];
+	if (q < *sample)
+		*sample = q;
+}
+
+void sdf_clear(struct DistanceField *field, const struct Vec2D *clip_min, const struct Vec2D *clip_max)
+{
+	++field->changes;
+	const struct Vec2D bb_min = { .x = -INFINITY, .y = -INFINITY };
+	const struct Vec2D bb_max = { .x = INFINITY, .y = INFINITY };
+	struct SampleRange range;
+	if (!sdf_range(field, &bb_min, &bb_max, clip_min, clip_max, &range))
+		return;
+	for (int y = range.y1; y <= range.y2; ++y)
+		for (int x = range.x1; x <= range.x2; ++x)
+		{
+			field->dist[y * field->cols + x] = SDF_MAX_SAMPLE;
+		}
+}
+
+void sdf_add_wall(struct DistanceField *field, const struct Wall *wall,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max)
+{
+	++field->changes;
+	const struct Vec2D bb_min = { .x = wall->bb_min.x - SDF_MAX_DIST, .y = wall->bb_min.y - SDF_MAX_DIST };
+	const struct Vec2D bb_max = { .x = wall->bb_max.x + SDF_MAX_DIST, .y = wall->bb_max.y + SDF_MAX_DIST };
+	struct SampleRange range;
+	if (!sdf_range(field, &bb_min, &bb_max, clip_min, clip_max, &range))
+		return;
+	for (int y = range.y1; y <= range.y2; ++y)
+		for (int x = range.x1; x <= range.x2; ++x)
+		{
+			const struct Vec2D pos = {
+				.x = field->origin_x + x * SDF_CELL_SIZE,
+				.y = field->origin_y + y * SDF_CELL_SIZE
+			};
+			struct Vec2D wd = wall_dist(wall, &pos);
+			sdf_store(field, x, y, vlen(&wd) - wall->r);
+		}
+}
+
+void sdf_add_circle(struct DistanceField *field, const struct Segment *seg,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max)
+{
+	++field->changes;
+	const double reach = seg->r + SDF_MAX_DIST;
+	const struct Vec2D bb_min = { .x = seg->pos.x - reach, .y = seg->pos.y - reach };
+	const struct Vec2D bb_max = { .x = seg->pos.x + reach, .y = seg->pos.y + reach };
+	struct SampleRange range;
+	if (!sdf_range(field, &bb_min, &bb_max, clip_min, clip_max, &range))
+		return;
+	for (int y = range.y1; y <= range.y2; ++y)
+		for (int x = range.x1; x <= range.x2; ++x)
+		{
+			const struct Vec2D pos = {
+				.x = field->origin_x + x * SDF_CELL_SIZE,
+				.y = field->origin_y + y * SDF_CELL_SIZE
+			};
+			sdf_store(field, x, y, vdist(&pos, &seg->pos) - seg->r);
+		}
+}
+
+double sdf_lower_bound(const struct DistanceField *field, const struct Vec2D *pos)
+{
+	if (!field->dist)
+		return -INFINITY;
+	const double fx = (pos->x - field->origin_x) * field->inv_cell_size;
+	const double fy = (pos->y - field->origin_y) * field->inv_cell_size;
+	if (!(fx >= 0 && fy >= 0 && fx < field->cols - 1 && fy < field->rows - 1))
+		return -INFINITY;
+	const int x = fx;
+	const int y = fy;
+	const double tx = fx - x;
+	const double ty = fy - y;
+	const short *s = &field->dist[y * field->cols + x];
+	const double top = s[0] + (s[1] - s[0]) * tx;
+	const double bottom = s[field->cols] + (s[field->cols + 1] - s[field->cols]) * tx;
+	return (top + (bottom - top) * ty) * (1.0 / SDF_SCALE) - SDF_SLACK;
+}
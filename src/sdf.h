@@ -0,0 +1,48 @@
+#ifndef _H_SDF
+#define _H_SDF
+
+// spacing of the samples
+#if defined(MIYOO)
+#define SDF_CELL_SIZE					(4.0)
+#else
+#define SDF_CELL_SIZE					(2.0)
+#endif
+// distances are clamped to this value, farther geometry is not stored
+#define SDF_MAX_DIST					(64.0)
+// samples are stored in 1/SDF_SCALE px, rounded down
+#define SDF_SCALE						(16.0)
+
+struct Vec2D;
+struct Segment;
+struct Wall;
+
+// signed distance to the nearest static geometry sampled on a regular
+// lattice, negative inside a wall or an obstacle
+struct DistanceField
+{
+	double origin_x;
+	double origin_y;
+	double inv_cell_size;
+	int cols;
+	int rows;
+	short *dist;
+	unsigned int changes;	// edits made, a copy is current if it has as many
+};
+
+void sdf_init(struct DistanceField *field, const struct Vec2D *bb_min, const struct Vec2D *bb_max);
+void sdf_dispose(struct DistanceField *field);
+// dst is zeroed or a copy of the same field, it is left as it is when current
+void sdf_copy(struct DistanceField *dst, const struct DistanceField *src);
+
+// the clipping box limits the samples touched, NULL for all of them
+void sdf_clear(struct DistanceField *field, const struct Vec2D *clip_min, const struct Vec2D *clip_max);
+void sdf_add_wall(struct DistanceField *field, const struct Wall *wall,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max);
+void sdf_add_circle(struct DistanceField *field, const struct Segment *seg,
+	const struct Vec2D *clip_min, const struct Vec2D *clip_max);
+
+// the geometry is not nearer to pos than the returned value,
+// -INFINITY outside of the field
+double sdf_lower_bound(const struct DistanceField *field, const struct Vec2D *pos);
+
+#endif
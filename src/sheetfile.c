@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "sheetfile.h"
+#include "main.h"
+
+#define SHEETFILE_VERSION	(1)
+#define SHEETFILE_ORDER		(0x01020304)
+
+// the rows follow it with no gaps, 4 bytes per pixel, so the file can
+// be mapped or read straight into a surface of the same pitch
+struct SheetHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t order;		// tells apart the files of the other byte order
+	uint32_t frames;
+	uint64_t source_hash;
+	uint32_t color;
+	uint16_t style;
+	uint16_t radius;
+	uint32_t masks[4];
+	uint32_t width;
+	uint32_t height;
+	uint64_t pixels_hash;
+};
+
+// a file found by sheetfile_prune
+struct SheetFile
+{
+	char path[128];
+	off_t size;
+	time_t mtime;
+};
+
+static const char sheetfile_magic[4] = { 'S', 'A', 'W', 'S' };
+
+static void sheetfile_path(char *path, size_t size, const struct SheetKey *key);
+static void sheetfile_expect(struct SheetHeader *header, const struct SheetKey *key, const SDL_Surface *surface);
+static uint64_t sheetfile_pixels_hash(const SDL_Surface *surface);
+static int sheetfile_compare_age(const void *a, const void *b);
+
+static void sheetfile_path(char *path, size_t size, const struct SheetKey *key)
+{
+	snprintf(path, size, CACHE_DIR "saw%d_%d_%08x.sheet", key->style, key->radius, (unsigned int)key->color);
+}
+
+// everything but the frames and the pixels is known before reading
+static void sheetfile_expect(struct SheetHeader *header, const struct SheetKey *key, const SDL_Surface *surface)
+{
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, sheetfile_magic, sizeof(sheetfile_magic));
+	header->version = SHEETFILE_VERSION;
+	header->order = SHEETFILE_ORDER;
+	header->source_hash = key->source_hash;
+	header->color = key->color;
+	header->style = key->style;
+	header->radius = key->radius;
+	header->masks[0] = surface->format->Rmask;
+	header->masks[1] = surface->format->Gmask;
+	header->masks[2] = surface->format->Bmask;
+	header->masks[3] = surface->format->Amask;
+	header->width = surface->w;
+	header->height = surface->h;
+}
+
+// FNV-1a over the pixels, a word at a time
+static uint64_t sheetfile_pixels_hash(const SDL_Surface *surface)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (int y = 0; y < surface->h; ++y)
+	{
+		const uint32_t *row = (const uint32_t *)((const char *)surface->pixels + y * surface->pitch);
+		for (int x = 0; x < surface->w; ++x)
+		{
+			hash ^= row[x];
+			hash *= 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+bool sheetfile_hash(const char *path, uint64_t *hash)
+{
+	FILE *file = fopen(path, "rb");
+	if (NULL == file)
+		return false;
+	unsigned char buffer[4096];
+	size_t read = 0;
+	*hash = 14695981039346656037ULL;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		for (size_t i = 0; i < read; ++i)
+		{
+			*hash ^= buffer[i];
+			*hash *= 1099511628211ULL;
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+bool sheetfile_load(const struct SheetKey *key, SDL_Surface *dst, int *frames)
+{
+	if (dst->format->BytesPerPixel != 4)
+		return false;
+	char path[128];
+	sheetfile_path(path, sizeof(path), key);
+	FILE *file = fopen(path, "rb");
+	if (NULL == file)
+		return false;
+
+	struct SheetHeader header, expected;
+	sheetfile_expect(&expected, key, dst);
+	bool valid = 1 == fread(&header, sizeof(header), 1, file);
+	if (valid)
+	{
+		expected.frames = header.frames;
+		expected.pixels_hash = header.pixels_hash;
+		valid = 0 == memcmp(&header, &expected, sizeof(header)) && header.frames > 0;
+	}
+	if (valid && SDL_MUSTLOCK(dst))
+		valid = SDL_LockSurface(dst) >= 0;
+	if (valid)
+	{
+		const size_t row_size = dst->w * 4;
+		if (dst->pitch == row_size)
+		{
+			valid = 1 == fread(dst->pixels, row_size * dst->h, 1, file);
+		}
+		else
+		{
+			for (int y = 0; y < dst->h && valid; ++y)
+				valid = 1 == fread((char *)dst->pixels + y * dst->pitch, row_size, 1, file);
+		}
+		// a short or damaged file is drawn again
+		valid = valid && EOF == fgetc(file) && sheetfile_pixels_hash(dst) == header.pixels_hash;
+		if (SDL_MUSTLOCK(dst))
+			SDL_UnlockSurface(dst);
+	}
+	fclose(file);
+	if (valid)
+	{
+		*frames = header.frames;
+		// so the files in use are the last to be pruned
+		utime(path, NULL);
+	}
+	return valid;
+}
+
+bool sheetfile_store(const struct SheetKey *key, SDL_Surface *src, int frames)
+{
+	if (src->format->BytesPerPixel != 4)
+		return false;
+	char path[128];
+	char temp[136];
+	sheetfile_path(path, sizeof(path), key);
+	snprintf(temp, sizeof(temp), "%s.tmp", path);
+	// it is there already most of the time
+	mkdir(CACHE_DIR, 0755);
+	FILE *file = fopen(temp, "wb");
+	if (NULL == file)
+		return false;
+
+	if (SDL_MUSTLOCK(src) && SDL_LockSurface(src) < 0)
+	{
+		fclose(file);
+		remove(temp);
+		return false;
+	}
+	struct SheetHeader header;
+	sheetfile_expect(&header, key, src);
+	header.frames = frames;
+	header.pixels_hash = sheetfile_pixels_hash(src);
+	bool valid = 1 == fwrite(&header, sizeof(header), 1, file);
+	const size_t row_size = src->w * 4;
+	for (int y = 0; y < src->h && valid; ++y)
+		valid = 1 == fwrite((const char *)src->pixels + y * src->pitch, row_size, 1, file);
+	if (SDL_MUSTLOCK(src))
+		SDL_UnlockSurface(src);
+
+	valid = 0 == fclose(file) && valid;
+	if (valid)
+		valid = 0 == rename(temp, path);
+	if (!valid)
+		remove(temp);
+	return valid;
+}
+
+static int sheetfile_compare_age(const void *a, const void *b)
+{
+	const struct SheetFile *fa = a;
+	const struct SheetFile *fb = b;
+	return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+void sheetfile_prune(size_t budget)
+{
+	DIR *dir = opendir(CACHE_DIR);
+	if (NULL == dir)
+		return;
+	struct SheetFile *files = NULL;
+	int files_num = 0;
+	int files_capacity = 0;
+	size_t total = 0;
+	const char suffix[] = ".sheet";
+	struct dirent *entry = NULL;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		const size_t len = strlen(entry->d_name);
+		if (len < sizeof(suffix) || 0 != strcmp(entry->d_name + len - sizeof(suffix) + 1, suffix))
+			continue;
+		if (files_num == files_capacity)
+		{
+			files_capacity = files_capacity * 2 + 16;
+			files = (struct SheetFile *)realloc(files, files_capacity * sizeof(struct SheetFile));
+		}
+		struct SheetFile *file = &files[files_num];
+		struct stat st;
+		snprintf(file->path, sizeof(file->path), CACHE_DIR "%s", entry->d_name);
+		if (0 != stat(file->path, &st) || !S_ISREG(st.st_mode))
+			continue;
+		file->size = st.st_size;
+		file->mtime = st.st_mtime;
+		total += st.st_size;
+		++files_num;
+	}
+	closedir(dir);
+
+	// the oldest go first
+	qsort(files, files_num, sizeof(struct SheetFile), sheetfile_compare_age);
+	for (int i = 0; i < files_num && total > budget; ++i)
+	{
+		if (0 == remove(files[i].path))
+			total -= files[i].size;
+	}
+	free(files);
+}
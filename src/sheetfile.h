@@ -0,0 +1,29 @@
+#ifndef _H_SHEETFILE
+#define _H_SHEETFILE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <SDL.h>
+
+// a sheet of sprites saved as it is in memory, so the next run reads it
+// back instead of drawing it again
+struct SheetKey
+{
+	uint64_t source_hash;	// of the file the sheet is drawn from
+	uint32_t color;
+	uint16_t style;
+	uint16_t radius;
+};
+
+// hash of the whole file, false if it cannot be read
+bool sheetfile_hash(const char *path, uint64_t *hash);
+// fills dst and *frames when the file is there and matches the key and
+// the size and the pixel format of dst
+bool sheetfile_load(const struct SheetKey *key, SDL_Surface *dst, int *frames);
+// written aside and renamed, so a file is either whole or missing
+bool sheetfile_store(const struct SheetKey *key, SDL_Surface *src, int frames);
+// removes the least recently used files until the rest fits the budget
+void sheetfile_prune(size_t budget);
+
+#endif
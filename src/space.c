@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <math.h>
+#include "space.h"
+#include "rng.h"
+#include "game.h"
+
+static bool space_is_free(const struct FreeSpace *space, int cell);
+static void space_refresh(struct FreeSpace *space, int cell);
+static void space_take(struct FreeSpace *space, const struct GridRect *rect, int delta);
+
+void space_init(struct FreeSpace *space, const struct Vec2D *bb_min, const struct Vec2D *bb_max)
+{
+	space->origin_x = bb_min->x;
+	space->origin_y = bb_min->y;
+	space->inv_cell_size = 1.0 / SPACE_CELL_SIZE;
+	space->cols = (int)ceil((bb_max->x - bb_min->x) * space->inv_cell_size);
+	space->rows = (int)ceil((bb_max->y - bb_min->y) * space->inv_cell_size);
+	if (space->cols < 1)
+		space->cols = 1;
+	if (space->rows < 1)
+		space->rows = 1;
+	const int num = space->cols * space->rows;
+	space->open = (bool *)calloc(num, sizeof(bool));
+	space->takers = (int *)calloc(num, sizeof(int));
+	space->slot = (int *)malloc(num * sizeof(int));
+	space->cells = (int *)malloc(num * sizeof(int));
+	for (int i = 0; i < num; ++i)
+	{
+		space->slot[i] = -1;
+	}
+	space->num = 0;
+}
+
+void space_dispose(struct FreeSpace *space)
+{
+	free(space->open);
+	free(space->takers);
+	free(space->slot);
+	free(space->cells);
+	space->open = NULL;
+	space->takers = NULL;
+	space->slot = NULL;
+	space->cells = NULL;
+	space->cols = space->rows = 0;
+	space->num = 0;
+}
+
+struct GridRect space_box(const struct FreeSpace *space, const struct Vec2D *bb_min, const struct Vec2D *bb_max)
+{
+	const int x1 = (int)fmax(floor((bb_min->x - space->origin_x) * space->inv_cell_size), 0);
+	const int y1 = (int)fmax(floor((bb_min->y - space->origin_y) * space->inv_cell_size), 0);
+	const int x2 = (int)fmin(floor((bb_max->x - space->origin_x) * space->inv_cell_size), space->cols - 1);
+	const int y2 = (int)fmin(floor((bb_max->y - space->origin_y) * space->inv_cell_size), space->rows - 1);
+	if (x1 > x2 || y1 > y2)
+		return (struct GridRect) { .x1 = -1 };
+	return (struct GridRect) { .x1 = x1, .y1 = y1, .x2 = x2, .y2 = y2 };
+}
+
+void space_cell_bounds(const struct FreeSpace *space, int x, int y, struct Vec2D *bb_min, struct Vec2D *bb_max)
+{
+	bb_min->x = space->origin_x + x * SPACE_CELL_SIZE;
+	bb_min->y = space->origin_y + y * SPACE_CELL_SIZE;
+	bb_max->x = bb_min->x + SPACE_CELL_SIZE;
+	bb_max->y = bb_min->y + SPACE_CELL_SIZE;
+}
+
+static bool space_is_free(const struct FreeSpace *space, int cell)
+{
+	return space->open[cell] && 0 == space->takers[cell];
+}
+
+// the cell joins or leaves the list when it has changed
+static void space_refresh(struct FreeSpace *space, int cell)
+{
+	const bool listed = space->slot[cell] >= 0;
+	if (listed == space_is_free(space, cell))
+		return;
+	if (listed)
+	{
+		// the last one fills the gap
+		const int last = space->cells[--space->num];
+		space->cells[space->slot[cell]] = last;
+		space->slot[last] = space->slot[cell];
+		space->slot[cell] = -1;
+	}
+	else
+	{
+		space->slot[cell] = space->num;
+		space->cells[space->num++] = cell;
+	}
+}
+
+void space_set_open(struct FreeSpace *space, int x, int y, bool open)
+{
+	const int cell = y * space->cols + x;
+	space->open[cell] = open;
+	space_refresh(space, cell);
+}
+
+static void space_take(struct FreeSpace *space, const struct GridRect *rect, int delta)
+{
+	for (int y = rect->y1; y <= rect->y2; ++y)
+		for (int x = rect->x1; x <= rect->x2; ++x)
+		{
+			const int cell = y * space->cols + x;
+			space->takers[cell] += delta;
+			space_refresh(space, cell);
+		}
+}
+
+void space_update(struct FreeSpace *space, struct GridRect *taken, const struct GridRect *rect)
+{
+	const bool had = taken->x1 >= 0;
+	const bool has = rect && rect->x1 >= 0;
+	if (had && has && grid_rect_equal(taken, rect))
+		return;
+	// the new cells are taken first, so the ones kept are never let go
+	if (has)
+		space_take(space, rect, 1);
+	if (had)
+		space_take(space, taken, -1);
+	taken->x1 = -1;
+	if (has)
+		*taken = *rect;
+}
+
+bool space_sample(const struct FreeSpace *space, struct Rng *rng, struct Vec2D *pos)
+{
+	if (0 == space->num)
+		return false;
+	const int cell = space->cells[rng_int(rng, space->num)];
+	pos->x = space->origin_x + (cell % space->cols + rng_double(rng)) * SPACE_CELL_SIZE;
+	pos->y = space->origin_y + (cell / space->cols + rng_double(rng)) * SPACE_CELL_SIZE;
+	return true;
+}
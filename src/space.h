@@ -0,0 +1,44 @@
+#ifndef _H_SPACE
+#define _H_SPACE
+
+#include <stdbool.h>
+#include "grid.h"
+
+// spacing of the cells
+#define SPACE_CELL_SIZE					(4)
+
+struct Vec2D;
+struct Rng;
+
+// cells where something can be placed, a cell is free when it is open
+// and nothing has taken it, the free ones are kept in a list so a random
+// one is picked at once
+struct FreeSpace
+{
+	double origin_x;
+	double origin_y;
+	double inv_cell_size;
+	int cols;
+	int rows;
+	bool *open;		// set by the owner, e.g. from the static geometry
+	int *takers;	// number of things that have taken the cell
+	int *slot;		// index of the cell in cells, -1 if it is not free
+	int *cells;		// the free cells, in no particular order
+	int num;
+};
+
+// all the cells are closed at first
+void space_init(struct FreeSpace *space, const struct Vec2D *bb_min, const struct Vec2D *bb_max);
+void space_dispose(struct FreeSpace *space);
+
+// cells overlapping the box, x1 < 0 if there are none
+struct GridRect space_box(const struct FreeSpace *space, const struct Vec2D *bb_min, const struct Vec2D *bb_max);
+void space_cell_bounds(const struct FreeSpace *space, int x, int y, struct Vec2D *bb_min, struct Vec2D *bb_max);
+void space_set_open(struct FreeSpace *space, int x, int y, bool open);
+// keeps the cells taken by something in *taken up to date, NULL rect
+// releases them
+void space_update(struct FreeSpace *space, struct GridRect *taken, const struct GridRect *rect);
+// uniformly random point of the free cells, false if there are none
+bool space_sample(const struct FreeSpace *space, struct Rng *rng, struct Vec2D *pos);
+
+#endif
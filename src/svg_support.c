@@ -4,6 +4,7 @@
 #include "nanosvg.h"
 #define NANOSVGRAST_IMPLEMENTATION
 #include "nanosvgrast.h"
+#include "svg_support.h"
 #include <stdio.h>
 #include <math.h>
 /* See if an image is contained in a data source */
@@ -27,69 +28,197 @@ int IMG_isSVG(SDL_RWops* src)
     return is_SVG;
 }
 
+static struct NSVGrasterizer* rasterizer = NULL;
+
 /* Load a SVG type image from an SDL datasource */
 SDL_Surface* SVG_LoadSizedSVG_RW(const char* src, int width, int height,
 	int cr, int cg, int cb, int ca, float angle)
 {
-    struct NSVGimage* image;
-    struct NSVGrasterizer* rasterizer;
-    SDL_Surface* surface = NULL;
-    float scale = 1.0f;
+    struct NSVGimage* image = SVG_Load(src);
+    if(!image)
+        return NULL;
+    SDL_Surface* surface = SVG_Rasterize(image, width, height, cr, cg, cb, ca, angle);
+    SVG_Free(image);
+    return surface;
+}
 
+struct NSVGimage* SVG_Load(const char* src)
+{
     /* For now just just use default units of pixels at 96 DPI */
-    image = nsvgParseFromFile(src, "px", 96, angle);
-    if(!image){
+    struct NSVGimage* image = nsvgParseFromFile(src, "px", 96, 0.0f);
+    if(!image)
         return NULL;
-    }
-    if(!image || image->width <= 0.0f || image->height <= 0.0f)
+    if(image->width <= 0.0f || image->height <= 0.0f)
     {
         IMG_SetError("Couldn't parse SVG image");
-        return NULL;
-    }
-    rasterizer = nsvgCreateRasterizer();
-    if(!rasterizer)
-    {
-        IMG_SetError("Couldn't create SVG rasterizer");
         nsvgDelete(image);
         return NULL;
     }
+    return image;
+}
+
+void SVG_Free(struct NSVGimage* image)
+{
+    if(image)
+        nsvgDelete(image);
+}
+
+static int svg_rasterize_locked(struct NSVGimage* image, SDL_Surface* dst, const SDL_Rect* rect,
+	float scale, int cr, int cg, int cb, int ca, float angle);
+static int svg_rasterize_into(struct NSVGrasterizer* with, struct NSVGimage* image,
+	SDL_Surface* dst, const SDL_Rect* rect,
+	float scale, int cr, int cg, int cb, int ca, float angle);
 
+static float svg_scale(const struct NSVGimage* image, int width, int height)
+{
     if(width > 0 && height > 0)
     {
         float scale_x = (float)width / image->width;
         float scale_y = (float)height / image->height;
 
-        scale = SDL_min(scale_x, scale_y);
+        return SDL_min(scale_x, scale_y);
     }
     else if(width > 0)
     {
-        scale = (float)width / image->width;
+        return (float)width / image->width;
     }
     else if(height > 0)
     {
-        scale = (float)height / image->height;
-    }
-    else
-    {
-        scale = 1.0f;
+        return (float)height / image->height;
     }
+    return 1.0f;
+}
+
+SDL_Surface* SVG_Rasterize(struct NSVGimage* image, int width, int height,
+	int cr, int cg, int cb, int ca, float angle)
+{
+    SDL_Surface* surface = NULL;
+    float scale = svg_scale(image, width, height);
 
     surface = SDL_CreateRGBSurface(0,
             (int)ceilf(image->width * scale),
             (int)ceilf(image->height * scale),
             32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
     if(!surface)
+        return NULL;
+
+    if(svg_rasterize_locked(image, surface, NULL, scale, cr, cg, cb, ca, angle) < 0)
     {
-        nsvgDeleteRasterizer(rasterizer);
-        nsvgDelete(image);
+        SDL_FreeSurface(surface);
         return NULL;
     }
+    return surface;
+}
 
-    nsvgRasterize(rasterizer, image, 0.0f, 0.0f, scale,
-            (unsigned char*)surface->pixels,
-            surface->w, surface->h, surface->pitch,
+int SVG_RasterizeInto(struct NSVGimage* image, SDL_Surface* dst, const SDL_Rect* rect,
+	int cr, int cg, int cb, int ca, float angle)
+{
+    float scale = rect ? svg_scale(image, rect->w, rect->h) : svg_scale(image, dst->w, dst->h);
+    return svg_rasterize_locked(image, dst, rect, scale, cr, cg, cb, ca, angle);
+}
+
+int SVG_RasterizeWith(struct NSVGrasterizer* with, struct NSVGimage* image,
+	SDL_Surface* dst, const SDL_Rect* rect,
+	int cr, int cg, int cb, int ca, float angle)
+{
+    float scale = rect ? svg_scale(image, rect->w, rect->h) : svg_scale(image, dst->w, dst->h);
+    return svg_rasterize_into(with, image, dst, rect, scale, cr, cg, cb, ca, angle);
+}
+
+struct NSVGrasterizer* SVG_CreateRasterizer(void)
+{
+    struct NSVGrasterizer* created = nsvgCreateRasterizer();
+    if(!created)
+        IMG_SetError("Couldn't create SVG rasterizer");
+    return created;
+}
+
+void SVG_DeleteRasterizer(struct NSVGrasterizer* with)
+{
+    if(with)
+        nsvgDeleteRasterizer(with);
+}
+
+/* Same byte order as the rasterizer output */
+static int svg_is_rgba(const SDL_PixelFormat* fmt)
+{
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    return fmt->Rmask == 0xff000000 && fmt->Gmask == 0x00ff0000
+        && fmt->Bmask == 0x0000ff00 && fmt->Amask == 0x000000ff;
+#else
+    return fmt->Rmask == 0x000000ff && fmt->Gmask == 0x0000ff00
+        && fmt->Bmask == 0x00ff0000 && fmt->Amask == 0xff000000;
+#endif
+}
+
+/* The shared rasterizer, with the surface locked around it */
+static int svg_rasterize_locked(struct NSVGimage* image, SDL_Surface* dst, const SDL_Rect* rect,
+	float scale, int cr, int cg, int cb, int ca, float angle)
+{
+    int result;
+
+    if(!rasterizer)
+    {
+        rasterizer = SVG_CreateRasterizer();
+        if(!rasterizer)
+            return -1;
+    }
+
+    if(SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0)
+        return -1;
+    result = svg_rasterize_into(rasterizer, image, dst, rect, scale, cr, cg, cb, ca, angle);
+    if(SDL_MUSTLOCK(dst))
+        SDL_UnlockSurface(dst);
+    return result;
+}
+
+static int svg_rasterize_into(struct NSVGrasterizer* with, struct NSVGimage* image,
+	SDL_Surface* dst, const SDL_Rect* rect,
+	float scale, int cr, int cg, int cb, int ca, float angle)
+{
+    SDL_Rect area = { 0, 0, dst->w, dst->h };
+    const SDL_PixelFormat* fmt = dst->format;
+
+    if(fmt->BytesPerPixel != 4)
+    {
+        IMG_SetError("SVG target must be 32 bits per pixel");
+        return -1;
+    }
+    if(rect)
+        area = *rect;
+    if(area.x < 0 || area.y < 0 || area.x + area.w > dst->w || area.y + area.h > dst->h)
+    {
+        IMG_SetError("SVG target rectangle out of bounds");
+        return -1;
+    }
+
+    /* The rasterizer clips to the rectangle, so nothing spills into the neighbours */
+    unsigned char* pixels = (unsigned char*)dst->pixels + area.y * dst->pitch + area.x * 4;
+    nsvgRasterizeRotated(with, image, 0.0f, 0.0f, scale, angle,
+            pixels, area.w, area.h, dst->pitch,
             cr, cg, cb, ca);
-    nsvgDeleteRasterizer(rasterizer);
-    nsvgDelete(image);
-    return surface;
+
+    /* The rasterizer writes R, G, B, A bytes, they are packed in place if the target differs */
+    if(!svg_is_rgba(fmt))
+    {
+        for(int y = 0; y < area.h; ++y)
+        {
+            unsigned char* row = pixels + y * dst->pitch;
+            for(int x = 0; x < area.w; ++x, row += 4)
+            {
+                Uint32 pixel = (row[0] >> fmt->Rloss) << fmt->Rshift
+                    | (row[1] >> fmt->Gloss) << fmt->Gshift
+                    | (row[2] >> fmt->Bloss) << fmt->Bshift
+                    | (Uint32)(row[3] >> fmt->Aloss) << fmt->Ashift;
+                SDL_memcpy(row, &pixel, 4);
+            }
+        }
+    }
+    return 0;
+}
+
+void SVG_Quit(void)
+{
+    SVG_DeleteRasterizer(rasterizer);
+    rasterizer = NULL;
 }
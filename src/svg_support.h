@@ -4,7 +4,31 @@
 
 int IMG_isSVG(SDL_RWops* src);
 
+struct NSVGimage;
+struct NSVGrasterizer;
+
 // it can return the surface greater than width x height
 SDL_Surface* SVG_LoadSizedSVG_RW(const char* src, int width, int height,
 	int cr, int cg, int cb, int ca, float angle);
+
+// parsed once and rasterized as many times as needed, NULL on failure
+struct NSVGimage* SVG_Load(const char* src);
+void SVG_Free(struct NSVGimage* image);
+// rotated by angle about its centre, the same rasterizer serves every call
+SDL_Surface* SVG_Rasterize(struct NSVGimage* image, int width, int height,
+	int cr, int cg, int cb, int ca, float angle);
+// renders straight into the rect of a 32-bit surface of any channel order,
+// NULL rect is the whole surface, the image is fitted to the rect, -1 on failure
+int SVG_RasterizeInto(struct NSVGimage* image, SDL_Surface* dst, const SDL_Rect* rect,
+	int cr, int cg, int cb, int ca, float angle);
+// the same with a rasterizer of the caller's own and without locking dst,
+// threads with rasterizers of their own may share an image and a locked
+// surface as long as their rects do not overlap
+int SVG_RasterizeWith(struct NSVGrasterizer* with, struct NSVGimage* image,
+	SDL_Surface* dst, const SDL_Rect* rect,
+	int cr, int cg, int cb, int ca, float angle);
+struct NSVGrasterizer* SVG_CreateRasterizer(void);
+void SVG_DeleteRasterizer(struct NSVGrasterizer* with);
+// frees the shared rasterizer
+void SVG_Quit(void);
 #endif
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include "timer.h"
+
+static void timer_link(struct TimerWheel *wheel, int timer);
+static void timer_unlink(struct TimerWheel *wheel, int timer);
+static void timer_cascade(struct TimerWheel *wheel, int level);
+static int compare_timers(const void *a, const void *b);
+
+void timer_init(struct TimerWheel *wheel, int timers_num)
+{
+	wheel->now = 0;
+	for (int l = 0; l < TIMER_LEVELS; ++l)
+		for (int s = 0; s < TIMER_SLOTS; ++s)
+		{
+			wheel->slots[l][s] = -1;
+		}
+	wheel->timers = (struct Timer *)malloc(timers_num * sizeof(struct Timer));
+	wheel->timers_num = timers_num;
+	for (int i = 0; i < timers_num; ++i)
+	{
+		wheel->timers[i] = (struct Timer) { .slot = -1, .prev = -1, .next = -1 };
+	}
+	wheel->fired = (int *)malloc(timers_num * sizeof(int));
+	wheel->fired_num = 0;
+}
+
+void timer_dispose(struct TimerWheel *wheel)
+{
+	free(wheel->timers);
+	free(wheel->fired);
+	wheel->timers = NULL;
+	wheel->fired = NULL;
+	wheel->timers_num = 0;
+	wheel->fired_num = 0;
+}
+
+// the level is picked by how far the expiry is, the slot by the expiry
+// itself, so a slot holds the timers of a single span until it is emptied
+static void timer_link(struct TimerWheel *wheel, int timer)
+{
+	struct Timer *t = &wheel->timers[timer];
+	unsigned int delta = t->due - wheel->now;
+	unsigned int due = t->due;
+	if (delta >= TIMER_RANGE)
+		due = wheel->now + TIMER_RANGE - 1;
+	int level = 0;
+	while (level < TIMER_LEVELS - 1 && (due - wheel->now) >> ((level + 1) * TIMER_SLOT_BITS))
+		++level;
+	const int s = (due >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1);
+	t->slot = level * TIMER_SLOTS + s;
+	t->prev = -1;
+	t->next = wheel->slots[level][s];
+	if (t->next >= 0)
+		wheel->timers[t->next].prev = timer;
+	wheel->slots[level][s] = timer;
+}
+
+static void timer_unlink(struct TimerWheel *wheel, int timer)
+{
+	struct Timer *t = &wheel->timers[timer];
+	if (t->prev >= 0)
+		wheel->timers[t->prev].next = t->next;
+	else
+		wheel->slots[t->slot / TIMER_SLOTS][t->slot % TIMER_SLOTS] = t->next;
+	if (t->next >= 0)
+		wheel->timers[t->next].prev = t->prev;
+	t->slot = -1;
+}
+
+void timer_set(struct TimerWheel *wheel, int timer, unsigned int delay)
+{
+	if (wheel->timers[timer].slot >= 0)
+		timer_unlink(wheel, timer);
+	// the slot of now has been gone through already
+	wheel->timers[timer].due = wheel->now + (delay > 0 ? delay : 1);
+	timer_link(wheel, timer);
+}
+
+void timer_cancel(struct TimerWheel *wheel, int timer)
+{
+	if (wheel->timers[timer].slot >= 0)
+		timer_unlink(wheel, timer);
+}
+
+// the timers of the current slot of the level move down, they are all
+// due within its span
+static void timer_cascade(struct TimerWheel *wheel, int level)
+{
+	const int s = (wheel->now >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1);
+	int timer = wheel->slots[level][s];
+	wheel->slots[level][s] = -1;
+	while (timer >= 0)
+	{
+		const int next = wheel->timers[timer].next;
+		timer_link(wheel, timer);
+		timer = next;
+	}
+}
+
+static int compare_timers(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+void timer_tick(struct TimerWheel *wheel)
+{
+	++wheel->now;
+	// the higher levels first, what they hand down may be due right now
+	for (int level = TIMER_LEVELS - 1; level > 0; --level)
+	{
+		if (0 == (wheel->now & ((1u << (level * TIMER_SLOT_BITS)) - 1)))
+			timer_cascade(wheel, level);
+	}
+
+	wheel->fired_num = 0;
+	const int s = wheel->now & (TIMER_SLOTS - 1);
+	int timer = wheel->slots[0][s];
+	wheel->slots[0][s] = -1;
+	while (timer >= 0)
+	{
+		struct Timer *t = &wheel->timers[timer];
+		t->slot = -1;
+		wheel->fired[wheel->fired_num++] = timer;
+		timer = t->next;
+	}
+	if (wheel->fired_num > 1)
+		qsort(wheel->fired, wheel->fired_num, sizeof(int), compare_timers);
+}
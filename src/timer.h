@@ -0,0 +1,46 @@
+#ifndef _H_TIMER
+#define _H_TIMER
+
+#include <stdbool.h>
+
+// levels of the wheel and slots on every level, a slot of a level
+// spans all the slots of the level below
+#define TIMER_LEVELS					(3)
+#define TIMER_SLOT_BITS					(6)
+#define TIMER_SLOTS						(1 << TIMER_SLOT_BITS)
+// timers due farther are parked on the last level until they get closer
+#define TIMER_RANGE						(1u << (TIMER_LEVELS * TIMER_SLOT_BITS))
+
+struct Timer
+{
+	unsigned int due;
+	int slot;	// level * TIMER_SLOTS + slot, -1 if the timer is not set
+	int prev;
+	int next;
+};
+
+// a fixed set of timers counting whole ticks, every timer is found only
+// in the slot of its expiry, so a tick touches only the timers that are
+// due and now and then a slot of the timers due later
+struct TimerWheel
+{
+	unsigned int now;	// ticks made
+	int slots[TIMER_LEVELS][TIMER_SLOTS];	// first timer, -1 if none
+	struct Timer *timers;
+	int timers_num;
+	int *fired;	// of the last timer_tick, in increasing order
+	int fired_num;
+};
+
+// none of the timers is set
+void timer_init(struct TimerWheel *wheel, int timers_num);
+void timer_dispose(struct TimerWheel *wheel);
+
+// the timer fires delay ticks from now, at least one, it is moved if it
+// has been set already
+void timer_set(struct TimerWheel *wheel, int timer, unsigned int delay);
+void timer_cancel(struct TimerWheel *wheel, int timer);
+// one tick forward, the timers due are in fired and are not set anymore
+void timer_tick(struct TimerWheel *wheel);
+
+#endif
@@ -0,0 +1,230 @@
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdbool.h>
+#include "workers.h"
+
+struct Job
+{
+	void (*func)(int index, void *data);
+	void *data;
+	int count;
+	int chunk;	// number of indices taken at once
+	int next;
+	int pending;
+};
+
+static SDL_Thread *threads[WORKERS_MAX];
+static int threads_num = 0;
+static SDL_mutex *lock = NULL;
+static SDL_cond *wake = NULL;
+static SDL_cond *done = NULL;
+static struct Job job;
+static unsigned int generation = 0;
+static bool quit = false;
+
+// the launched job, kept apart from the pool so both can be busy at once
+static SDL_Thread *background = NULL;
+static SDL_mutex *background_lock = NULL;
+static SDL_cond *background_wake = NULL;
+static SDL_cond *background_done = NULL;
+static void (*background_job)(void *data) = NULL;
+static void *background_data = NULL;
+static bool background_quit = false;
+static bool background_failed = false;
+
+static int worker_main(void *unused);
+static void job_run(void);
+static int background_main(void *unused);
+
+void workers_init(int count)
+{
+	if (count > WORKERS_MAX)
+		count = WORKERS_MAX;
+	lock = SDL_CreateMutex();
+	wake = SDL_CreateCond();
+	done = SDL_CreateCond();
+	quit = false;
+	for (threads_num = 0; threads_num < count; ++threads_num)
+	{
+		threads[threads_num] = SDL_CreateThread(worker_main, NULL);
+		if (NULL == threads[threads_num])
+		{
+			// not critical, just fewer helpers
+			printf("SDL_CreateThread: %s\n", SDL_GetError());
+			break;
+		}
+	}
+}
+
+void workers_dispose(void)
+{
+	if (background)
+	{
+		SDL_LockMutex(background_lock);
+		while (background_job)
+			SDL_CondWait(background_done, background_lock);
+		background_quit = true;
+		SDL_CondSignal(background_wake);
+		SDL_UnlockMutex(background_lock);
+		SDL_WaitThread(background, NULL);
+		background = NULL;
+		SDL_DestroyCond(background_done);
+		SDL_DestroyCond(background_wake);
+		SDL_DestroyMutex(background_lock);
+		background_done = background_wake = NULL;
+		background_lock = NULL;
+	}
+	background_failed = false;
+
+	SDL_LockMutex(lock);
+	quit = true;
+	SDL_CondBroadcast(wake);
+	SDL_UnlockMutex(lock);
+	for (int i = 0; i < threads_num; ++i)
+	{
+		SDL_WaitThread(threads[i], NULL);
+	}
+	threads_num = 0;
+	SDL_DestroyCond(done);
+	SDL_DestroyCond(wake);
+	SDL_DestroyMutex(lock);
+	done = wake = NULL;
+	lock = NULL;
+}
+
+int workers_count(void)
+{
+	return threads_num;
+}
+
+void workers_parallel_for(int count, void (*func)(int index, void *data), void *data)
+{
+	if (0 == threads_num || count < 2)
+	{
+		for (int i = 0; i < count; ++i)
+			func(i, data);
+		return;
+	}
+
+	SDL_LockMutex(lock);
+	job.func = func;
+	job.data = data;
+	job.count = count;
+	job.chunk = count / (4 * (threads_num + 1));
+	if (job.chunk < 1)
+		job.chunk = 1;
+	job.next = 0;
+	job.pending = count;
+	++generation;
+	SDL_CondBroadcast(wake);
+	job_run();
+	while (job.pending > 0)
+		SDL_CondWait(done, lock);
+	SDL_UnlockMutex(lock);
+}
+
+static int worker_main(void *unused)
+{
+	(void)unused;
+	unsigned int seen = 0;
+	SDL_LockMutex(lock);
+	while (true)
+	{
+		while (!quit && seen == generation)
+			SDL_CondWait(wake, lock);
+		if (quit)
+			break;
+		seen = generation;
+		job_run();
+	}
+	SDL_UnlockMutex(lock);
+	return 0;
+}
+
+// must be called with the lock held, the lock is released while working
+static void job_run(void)
+{
+	while (job.next < job.count)
+	{
+		int first = job.next;
+		int last = first + job.chunk;
+		if (last > job.count)
+			last = job.count;
+		job.next = last;
+		SDL_UnlockMutex(lock);
+		for (int i = first; i < last; ++i)
+			job.func(i, job.data);
+		SDL_LockMutex(lock);
+		job.pending -= last - first;
+		if (0 == job.pending)
+			SDL_CondBroadcast(done);
+	}
+}
+
+void workers_launch(void (*func)(void *data), void *data)
+{
+	// the thread is started on the first use only
+	if (!background && !background_failed)
+	{
+		background_lock = SDL_CreateMutex();
+		background_wake = SDL_CreateCond();
+		background_done = SDL_CreateCond();
+		background_quit = false;
+		background = SDL_CreateThread(background_main, NULL);
+		if (NULL == background)
+		{
+			// not critical, the job is just not overlapped
+			printf("SDL_CreateThread: %s\n", SDL_GetError());
+			background_failed = true;
+			SDL_DestroyCond(background_done);
+			SDL_DestroyCond(background_wake);
+			SDL_DestroyMutex(background_lock);
+			background_done = background_wake = NULL;
+			background_lock = NULL;
+		}
+	}
+	if (!background)
+	{
+		func(data);
+		return;
+	}
+
+	SDL_LockMutex(background_lock);
+	// one job at a time, the one still running is waited for
+	while (background_job)
+		SDL_CondWait(background_done, background_lock);
+	background_job = func;
+	background_data = data;
+	SDL_CondSignal(background_wake);
+	SDL_UnlockMutex(background_lock);
+}
+
+void workers_join(void)
+{
+	if (!background)
+		return;
+	SDL_LockMutex(background_lock);
+	while (background_job)
+		SDL_CondWait(background_done, background_lock);
+	SDL_UnlockMutex(background_lock);
+}
+
+static int background_main(void *unused)
+{
+	(void)unused;
+	SDL_LockMutex(background_lock);
+	while (true)
+	{
+		while (!background_quit && !background_job)
+			SDL_CondWait(background_wake, background_lock);
+		if (background_quit)
+			break;
+		SDL_UnlockMutex(background_lock);
+		background_job(background_data);
+		SDL_LockMutex(background_lock);
+		background_job = NULL;
+		SDL_CondSignal(background_done);
+	}
+	SDL_UnlockMutex(background_lock);
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _H_WORKERS
+#define _H_WORKERS
+
+#define WORKERS_MAX						(16)
+
+// the calling thread always takes part in the work, so count may be 0
+void workers_init(int count);
+void workers_dispose(void);
+int workers_count(void);
+// calls job(i, data) for every i in [0, count) and waits for completion
+void workers_parallel_for(int count, void (*job)(int index, void *data), void *data);
+// calls job(data) on a thread of its own next to the pool and returns at once,
+// a job still under way is waited for first, it runs inline if there is no
+// such thread
+void workers_launch(void (*job)(void *data), void *data);
+// waits for the launched job to complete
+void workers_join(void);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+ * Checks the alias table of the food draw. Every number rng_int can give
+ * is mapped to a food, each food must come out exactly weight * FOOD_END
+ * times. Then the draws of get_random_food itself must pass a chi-square
+ * test. Done for the locked, the unlocked and random weights.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include "food.h"
+#include "rng.h"
+
+#define DRAWS				(1000000)
+#define RANDOM_SETS			(200)
+#define WEIGHT_MAX			(12)
+// normal quantile of the chi-square bound, p = 0.0001
+#define CHI2_Z				(3.719)
+
+static bool check_exact(const char *name);
+static bool check_draws(const char *name, struct Rng *rng);
+static double chi2_bound(int df);
+
+static bool check_exact(const char *name)
+{
+	int counts[FOOD_END] = { 0 };
+	for (int prob = 0; prob < FOOD_END * food_weights_sum(); ++prob)
+	{
+		const enum Food food = food_pick(prob);
+		if (food < 0 || food >= FOOD_END)
+		{
+			printf("%s: number %d gives food %d\n", name, prob, food);
+			return false;
+		}
+		++counts[food];
+	}
+	for (int i = 0; i < FOOD_END; ++i)
+	{
+		if (counts[i] != food_weight(i) * FOOD_END)
+		{
+			printf("%s: food %d comes out %d times instead of %d\n",
+				name, i, counts[i], food_weight(i) * FOOD_END);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Wilson-Hilferty approximation of the quantile
+static double chi2_bound(int df)
+{
+	const double k = 2.0 / (9.0 * df);
+	const double c = 1.0 - k + CHI2_Z * sqrt(k);
+	return df * c * c * c;
+}
+
+static bool check_draws(const char *name, struct Rng *rng)
+{
+	int counts[FOOD_END] = { 0 };
+	for (int i = 0; i < DRAWS; ++i)
+	{
+		++counts[get_random_food(rng)];
+	}
+	double chi2 = 0;
+	int df = -1;
+	for (int i = 0; i < FOOD_END; ++i)
+	{
+		if (0 == food_weight(i))
+		{
+			if (counts[i] > 0)
+			{
+				printf("%s: food %d has no weight but came out %d times\n", name, i, counts[i]);
+				return false;
+			}
+			continue;
+		}
+		const double expected = (double)DRAWS * food_weight(i) / food_weights_sum();
+		chi2 += (counts[i] - expected) * (counts[i] - expected) / expected;
+		++df;
+	}
+	if (df > 0 && chi2 > chi2_bound(df))
+	{
+		printf("%s: chi-square %.1f over %.1f with %d degrees of freedom\n",
+			name, chi2, chi2_bound(df), df);
+		return false;
+	}
+	return true;
+}
+
+int main(void)
+{
+	struct Rng rng;
+	rng_seed(&rng, 42, 7);
+	int failed = 0;
+
+	food_lock();
+	failed += !check_exact("locked") + !check_draws("locked", &rng);
+	food_unlock();
+	failed += !check_exact("unlocked") + !check_draws("unlocked", &rng);
+
+	for (int set = 0; set < RANDOM_SETS; ++set)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "random %d", set);
+		// some foods left out, every few sets all but one
+		const int zeros = set % 8 == 0 ? FOOD_END : rng_int(&rng, FOOD_END);
+		for (int i = 0; i < FOOD_END; ++i)
+		{
+			food_set_weight(i, rng_int(&rng, FOOD_END) < zeros ? 0 : rng_int(&rng, WEIGHT_MAX) + 1);
+		}
+		if (FOOD_END == zeros)
+			food_set_weight(rng_int(&rng, FOOD_END), rng_int(&rng, WEIGHT_MAX) + 1);
+		food_evaluate_probability();
+		if (0 == food_weights_sum())
+			continue;
+		failed += !check_exact(name);
+		// the draws are slower, a part of the sets is enough
+		if (set % 10 == 0)
+			failed += !check_draws(name, &rng);
+	}
+
+	printf("%s\n", failed ? "FAILED" : "ok");
+	return failed ? 1 : 0;
+}